@@ -1,8 +1,196 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
 #include <cmath>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
+#ifdef BIGINTEGER_STATS
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Build with -DBIGINTEGER_STATS to collect per-operation call counts,
+// operand size histograms (log2 of the limb count), cycles and limb buffer
+// allocations. Cycles are inclusive: a division also bills its inner
+// multiplications. Without the flag the probes expand to nothing.
+struct BigIntegerStats {
+  enum class Operation {
+    add,
+    sub,
+    mul,
+    div,
+    mod,
+    gcd,
+    toString,
+    parse
+  };
+  static const size_t kOperations = 8;
+  static const size_t kBuckets = 32;
+
+  struct OperationStats {
+    uint64_t calls = 0;
+    uint64_t cycles = 0;
+    std::array<uint64_t, kBuckets> limbs{};
+  };
+
+  std::array<OperationStats, kOperations> operations{};
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+
+  const OperationStats& operator[](Operation op) const {
+    return operations[static_cast<size_t>(op)];
+  }
+
+  static const char* name(Operation op) {
+    static const char* names[kOperations] = {"add", "sub", "mul", "div",
+                                             "mod", "gcd", "toString", "parse"};
+    return names[static_cast<size_t>(op)];
+  }
+
+  static BigIntegerStats snapshot();
+  static void reset();
+
+#ifdef BIGINTEGER_STATS
+  struct Counters {
+    struct Slot {
+      std::atomic<uint64_t> calls{0};
+      std::atomic<uint64_t> cycles{0};
+      std::array<std::atomic<uint64_t>, kBuckets> limbs{};
+    };
+    std::array<Slot, kOperations> operations;
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> allocated_bytes{0};
+  };
+
+  static Counters& Global() {
+    static Counters counters;
+    return counters;
+  }
+
+  static uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+  }
+
+  class Probe {
+   private:
+    Counters::Slot& counters_;
+    uint64_t start_;
+
+   public:
+    Probe(Operation op, size_t limbs)
+        : counters_(Global().operations[static_cast<size_t>(op)]), start_(Now()) {
+      counters_.calls.fetch_add(1, std::memory_order_relaxed);
+      counters_.limbs[std::min<size_t>(std::bit_width(limbs), kBuckets - 1)].fetch_add(
+          1, std::memory_order_relaxed);
+    }
+    Probe(const Probe&) = delete;
+    ~Probe() { counters_.cycles.fetch_add(Now() - start_, std::memory_order_relaxed); }
+  };
+
+  template <typename T>
+  struct Allocator {
+    using value_type = T;
+
+    Allocator() = default;
+    template <typename U>
+    Allocator(const Allocator<U>&) {}
+
+    T* allocate(size_t count) {
+      Global().allocations.fetch_add(1, std::memory_order_relaxed);
+      Global().allocated_bytes.fetch_add(count * sizeof(T), std::memory_order_relaxed);
+      return std::allocator<T>().allocate(count);
+    }
+    void deallocate(T* ptr, size_t count) { std::allocator<T>().deallocate(ptr, count); }
+
+    template <typename U>
+    bool operator==(const Allocator<U>&) const { return true; }
+  };
+#else
+  template <typename T>
+  using Allocator = std::allocator<T>;
+#endif
+};
+
+#ifdef BIGINTEGER_STATS
+#define BIGINTEGER_PROFILE(op, limbs) \
+  BigIntegerStats::Probe bigint_probe_(BigIntegerStats::Operation::op, limbs)
+#else
+#define BIGINTEGER_PROFILE(op, limbs)
+#endif
+
+BigIntegerStats BigIntegerStats::snapshot() {
+  BigIntegerStats result;
+#ifdef BIGINTEGER_STATS
+  Counters& counters = Global();
+  for (size_t i = 0; i < kOperations; ++i) {
+    result.operations[i].calls = counters.operations[i].calls.load(std::memory_order_relaxed);
+    result.operations[i].cycles = counters.operations[i].cycles.load(std::memory_order_relaxed);
+    for (size_t j = 0; j < kBuckets; ++j) {
+      result.operations[i].limbs[j] =
+          counters.operations[i].limbs[j].load(std::memory_order_relaxed);
+    }
+  }
+  result.allocations = counters.allocations.load(std::memory_order_relaxed);
+  result.allocated_bytes = counters.allocated_bytes.load(std::memory_order_relaxed);
+#endif
+  return result;
+}
+
+void BigIntegerStats::reset() {
+#ifdef BIGINTEGER_STATS
+  Counters& counters = Global();
+  for (auto& op : counters.operations) {
+    op.calls = 0;
+    op.cycles = 0;
+    for (auto& bucket : op.limbs) {
+      bucket = 0;
+    }
+  }
+  counters.allocations = 0;
+  counters.allocated_bytes = 0;
+#endif
+}
+
+std::ostream& operator<<(std::ostream& output, const BigIntegerStats& stats) {
+  for (size_t i = 0; i < BigIntegerStats::kOperations; ++i) {
+    auto op = static_cast<BigIntegerStats::Operation>(i);
+    output << BigIntegerStats::name(op) << ": calls=" << stats[op].calls
+           << " cycles=" << stats[op].cycles << " limbs(log2)=[";
+    for (size_t j = 0; j < BigIntegerStats::kBuckets; ++j) {
+      if (stats[op].limbs[j] != 0) {
+        output << ' ' << j << ':' << stats[op].limbs[j];
+      }
+    }
+    output << " ]\n";
+  }
+  output << "allocations=" << stats.allocations << " bytes=" << stats.allocated_bytes << '\n';
+  return output;
+}
+
 class BigInteger {
   friend class Rational;
   enum class Sign {
@@ -13,8 +201,12 @@ class BigInteger {
  private:
   static const int kBase = 1e4;
   static const int kLength = 4;
-  std::vector<int> num_;
+  std::vector<int, BigIntegerStats::Allocator<int>> num_;
   Sign sign_;
+  // Cached hash of the limbs (0 = not computed yet), reset on every change
+  // of num_; the sign is mixed in separately so flipping it keeps the cache.
+  // Relaxed atomic since const lookups from several threads may fill it
+  mutable std::atomic<size_t> hash_ = 0;
   std::string DoRightLength(std::string str) const {
     if (str.size() % kLength != 0) {
       str = std::string((kLength - str.size() % kLength) % kLength, '0') + str;
@@ -28,18 +220,47 @@ class BigInteger {
     if (num_.size() == 1 && num_[0] == 0) {
       sign_ = Sign::zero;
     }
+    hash_.store(0, std::memory_order_relaxed);
   }
+  static uint64_t Mix(uint64_t value) {
+    value ^= value >> 32;
+    value *= 0xD6E8FEB86659FD93ULL;
+    value ^= value >> 32;
+    value *= 0xD6E8FEB86659FD93ULL;
+    value ^= value >> 32;
+    return value;
+  }
+
+  // Binary format: version byte, then sign byte, limb count (u32 LE)
+  // and the limbs themselves (u16 LE each, least significant first)
+  static const uint8_t kSerialVersion = 1;
+  static const size_t kHeaderSize = 1 + 4;
+  static void WriteLe(char* out, uint64_t value, size_t bytes);
+  static uint64_t ReadLe(const char* in, size_t bytes);
+  size_t BodySize() const;
+  char* WriteBody(char* out) const;
+  static BigInteger ReadBody(std::span<const char>& buffer);
+  static BigInteger ReadBody(std::istream& input);
 
  public:
   void swap(BigInteger& other) {
     std::swap(num_, other.num_);
     std::swap(sign_, other.sign_);
+    size_t hash = hash_.load(std::memory_order_relaxed);
+    hash_.store(other.hash_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    other.hash_.store(hash, std::memory_order_relaxed);
   }
 
   BigInteger();
+  BigInteger(const BigInteger& other);
+  BigInteger(BigInteger&& other) noexcept;
   explicit BigInteger(const std::string& str);
+  BigInteger(const char* first, const char* last);
   BigInteger(int value);
 
+  BigInteger& operator=(const BigInteger& other);
+  BigInteger& operator=(BigInteger&& other) noexcept;
+
   std::string toString() const;
 
   explicit operator bool() const;
@@ -57,6 +278,16 @@ class BigInteger {
   BigInteger operator-() const;
 
   std::weak_ordering operator<=>(const BigInteger& other) const;
+
+  size_t serializedSize() const;
+  void serialize(std::ostream& output) const;
+  size_t serialize(std::span<char> buffer) const;
+  static BigInteger deserialize(std::istream& input);
+  static BigInteger deserialize(std::span<const char>& buffer);
+
+  size_t hash() const;
+
+  friend bool operator==(const BigInteger& first, const BigInteger& second);
 };
 
 BigInteger operator""_bi(const char* str, size_t) {
@@ -94,7 +325,15 @@ BigInteger operator%(const BigInteger& first, const BigInteger& second) {
 }
 
 bool operator==(const BigInteger& first, const BigInteger& second) {
-  return first.toString() == second.toString();
+  if (first.sign_ != second.sign_ || first.num_.size() != second.num_.size()) {
+    return false;
+  }
+  size_t first_hash = first.hash_.load(std::memory_order_relaxed);
+  size_t second_hash = second.hash_.load(std::memory_order_relaxed);
+  if (first_hash != 0 && second_hash != 0 && first_hash != second_hash) {
+    return false;
+  }
+  return first.num_ == second.num_;
 }
 bool operator!=(const BigInteger& first, const BigInteger& second) { return !(first == second); }
 
@@ -103,39 +342,147 @@ std::ostream& operator<<(std::ostream& output, const BigInteger& num) {
   return output;
 }
 std::istream& operator>>(std::istream& input, BigInteger& num) {
-  std::string buffer;
-  input >> buffer;
-  num = BigInteger(buffer);
+  std::istream::sentry sentry(input);
+  if (!sentry) {
+    return input;
+  }
+  // Digits are collected straight from the stream buffer into a reused
+  // per-thread scratch string, so no allocation happens per token
+  thread_local std::string buffer;
+  buffer.clear();
+  std::streambuf* source = input.rdbuf();
+  int sym = source->sgetc();
+  if (sym == '-' || sym == '+') {
+    buffer.push_back(static_cast<char>(sym));
+    sym = source->snextc();
+  }
+  while (sym != std::char_traits<char>::eof() && sym >= '0' && sym <= '9') {
+    buffer.push_back(static_cast<char>(sym));
+    sym = source->snextc();
+  }
+  if (sym == std::char_traits<char>::eof()) {
+    input.setstate(std::ios::eofbit);
+  }
+  if (buffer.empty() || buffer == "-" || buffer == "+") {
+    input.setstate(std::ios::failbit);
+    return input;
+  }
+  BigInteger result(buffer.data(), buffer.data() + buffer.size());
+  num.swap(result);
   return input;
 }
 
+std::vector<BigInteger> parseBigIntegers(const char* first, const char* last,
+                                         size_t threads = std::thread::hardware_concurrency()) {
+  auto is_space = [](char sym) { return std::isspace(static_cast<unsigned char>(sym)) != 0; };
+  auto parse = [&is_space](const char* begin, const char* end, std::vector<BigInteger>& out) {
+    while (begin != end) {
+      while (begin != end && is_space(*begin)) {
+        ++begin;
+      }
+      const char* token = begin;
+      while (begin != end && !is_space(*begin)) {
+        ++begin;
+      }
+      if (token != begin) {
+        out.emplace_back(token, begin);
+      }
+    }
+  };
+
+  // Split the range at whitespace so that no token straddles two workers
+  threads = std::max<size_t>(1, std::min<size_t>(threads, (last - first) / (1 << 16) + 1));
+  std::vector<const char*> bounds(1, first);
+  for (size_t i = 1; i < threads; ++i) {
+    const char* bound = std::max(bounds.back(), first + (last - first) * i / threads);
+    while (bound != last && !is_space(*bound)) {
+      ++bound;
+    }
+    bounds.push_back(bound);
+  }
+  bounds.push_back(last);
+
+  std::vector<std::vector<BigInteger>> parts(threads);
+  std::vector<std::exception_ptr> errors(threads);
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; ++i) {
+    workers.emplace_back([&, i] {
+      try {
+        parse(bounds[i], bounds[i + 1], parts[i]);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  try {
+    parse(bounds[0], bounds[1], parts[0]);
+  } catch (...) {
+    errors[0] = std::current_exception();
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (const std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  size_t total = 0;
+  for (const auto& part : parts) {
+    total += part.size();
+  }
+  std::vector<BigInteger> result;
+  result.reserve(total);
+  for (auto& part : parts) {
+    std::move(part.begin(), part.end(), std::back_inserter(result));
+  }
+  return result;
+}
+
+std::vector<BigInteger> parseBigIntegers(std::istream& input,
+                                         size_t threads = std::thread::hardware_concurrency()) {
+  std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  return parseBigIntegers(content.data(), content.data() + content.size(), threads);
+}
+
 BigInteger::BigInteger() : num_(1, 0), sign_(Sign::zero) {}
-BigInteger::BigInteger(const std::string& string) : sign_(Sign::zero) {
-  if (string == "0" || string.empty()) {
+BigInteger::BigInteger(const BigInteger& other)
+    : num_(other.num_),
+      sign_(other.sign_),
+      hash_(other.hash_.load(std::memory_order_relaxed)) {}
+BigInteger::BigInteger(BigInteger&& other) noexcept
+    : num_(std::move(other.num_)),
+      sign_(other.sign_),
+      hash_(other.hash_.load(std::memory_order_relaxed)) {}
+BigInteger::BigInteger(const std::string& string)
+    : BigInteger(string.data(), string.data() + string.size()) {}
+BigInteger::BigInteger(const char* first, const char* last) : sign_(Sign::plus) {
+  if (first != last && (*first == '-' || *first == '+')) {
+    sign_ = (*first == '-' ? Sign::minus : Sign::plus);
+    ++first;
+  }
+  // Bucketed by limb count like every other operation
+  BIGINTEGER_PROFILE(parse, std::max<size_t>((last - first + kLength - 1) / kLength, 1));
+  if (first == last) {
+    sign_ = Sign::zero;
     num_.push_back(0);
     return;
   }
-  std::string copy = string;
-  std::string buffer;
-  long long buf_ind;
-  long long buf_len;
-  if (copy[0] == '-') {
-    sign_ = Sign::minus;
-    copy.erase(0, 1);
-  } else {
-    sign_ = Sign::plus;
-  }
-  for (long long i = static_cast<long long>(copy.size()); i > 0; i -= kLength) {
-    if (i <= kLength) {
-      buf_ind = 0;
-      buf_len = i;
-    } else {
-      buf_ind = i - kLength;
-      buf_len = static_cast<long long>(kLength);
+  num_.reserve((last - first + kLength - 1) / kLength);
+  while (last != first) {
+    const char* chunk = (last - first > kLength ? last - kLength : first);
+    int limb = 0;
+    for (const char* it = chunk; it != last; ++it) {
+      if (*it < '0' || *it > '9') {
+        throw std::invalid_argument("BigInteger: invalid digit");
+      }
+      limb = limb * 10 + (*it - '0');
     }
-    buffer = copy.substr(buf_ind, buf_len);
-    num_.push_back(std::stoi(buffer));
+    num_.push_back(limb);
+    last = chunk;
   }
+  DeleteZeroes();
 }
 BigInteger::BigInteger(int value) {
   if (value == 0) {
@@ -152,7 +499,20 @@ BigInteger::BigInteger(int value) {
   DeleteZeroes();
 }
 
+BigInteger& BigInteger::operator=(const BigInteger& other) {
+  BigInteger copy = other;
+  swap(copy);
+  return *this;
+}
+BigInteger& BigInteger::operator=(BigInteger&& other) noexcept {
+  num_ = std::move(other.num_);
+  sign_ = other.sign_;
+  hash_.store(other.hash_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  return *this;
+}
+
 std::string BigInteger::toString() const {
+  BIGINTEGER_PROFILE(toString, num_.size());
   if (sign_ == Sign::zero) {
     return "0";
   }
@@ -172,6 +532,7 @@ BigInteger::operator bool() const {
 }
 
 BigInteger& BigInteger::operator+=(const BigInteger& other) {
+  BIGINTEGER_PROFILE(add, std::max(num_.size(), other.num_.size()));
   if (other.sign_ == Sign::zero) {
     return *this;
   }
@@ -215,6 +576,7 @@ BigInteger& BigInteger::operator+=(const BigInteger& other) {
   return *this;
 }
 BigInteger& BigInteger::operator-=(const BigInteger& other) {
+  BIGINTEGER_PROFILE(sub, std::max(num_.size(), other.num_.size()));
   if (other.sign_ == Sign::zero) {
     return *this;
   }
@@ -267,8 +629,9 @@ BigInteger& BigInteger::operator-=(const BigInteger& other) {
   return *this;
 }
 BigInteger& BigInteger::operator*=(const BigInteger& other) {
+  BIGINTEGER_PROFILE(mul, std::max(num_.size(), other.num_.size()));
   if (other == 0) {
-    *this = BigInteger("0");
+    *this = BigInteger(0);
     return *this;
   }
 
@@ -297,16 +660,17 @@ BigInteger& BigInteger::operator*=(const BigInteger& other) {
   return *this;
 }
 BigInteger& BigInteger::operator/=(const BigInteger& other) {
+  BIGINTEGER_PROFILE(div, std::max(num_.size(), other.num_.size()));
   if (*this == 0) {
     return *this;
   }
   if ((*this >= 0 ? *this : -*this) == (other >= 0 ? other : -other)) {
-    *this = BigInteger("1");
+    *this = BigInteger(1);
     sign_ = (sign_ == other.sign_ ? Sign::plus : Sign::minus);
     return *this;
   }
   if ((*this >= 0 ? *this : -*this) < (other >= 0 ? other : -other)) {
-    *this = BigInteger("0");
+    *this = BigInteger(0);
     return *this;
   }
 
@@ -354,6 +718,7 @@ BigInteger& BigInteger::operator/=(const BigInteger& other) {
   return *this;
 }
 BigInteger& BigInteger::operator%=(const BigInteger& other) {
+  BIGINTEGER_PROFILE(mod, std::max(num_.size(), other.num_.size()));
   Sign buf_sign = sign_;
   BigInteger copy = other;
   copy.sign_ = Sign::plus;
@@ -365,7 +730,7 @@ BigInteger& BigInteger::operator%=(const BigInteger& other) {
 }
 
 BigInteger& BigInteger::operator++() {
-  *this += "1"_bi;
+  *this += 1;
   return *this;
 }
 BigInteger BigInteger::operator++(int) {
@@ -433,6 +798,140 @@ std::weak_ordering BigInteger::operator<=>(const BigInteger& other) const {
   return std::weak_ordering::equivalent;
 }
 
+void BigInteger::WriteLe(char* out, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+  }
+}
+
+uint64_t BigInteger::ReadLe(const char* in, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+  }
+  return value;
+}
+
+size_t BigInteger::BodySize() const { return kHeaderSize + 2 * num_.size(); }
+
+char* BigInteger::WriteBody(char* out) const {
+  out[0] = static_cast<char>(sign_);
+  WriteLe(out + 1, num_.size(), 4);
+  out += kHeaderSize;
+  for (int limb : num_) {
+    WriteLe(out, limb, 2);
+    out += 2;
+  }
+  return out;
+}
+
+BigInteger BigInteger::ReadBody(std::span<const char>& buffer) {
+  if (buffer.size() < kHeaderSize) {
+    throw std::runtime_error("BigInteger: truncated header");
+  }
+  uint8_t sign = static_cast<uint8_t>(buffer[0]);
+  size_t count = ReadLe(buffer.data() + 1, 4);
+  if (sign > static_cast<uint8_t>(Sign::plus) || count == 0) {
+    throw std::runtime_error("BigInteger: malformed header");
+  }
+  if (buffer.size() - kHeaderSize < 2 * count) {
+    throw std::runtime_error("BigInteger: truncated limbs");
+  }
+  BigInteger result;
+  result.sign_ = static_cast<Sign>(sign);
+  result.num_.resize(count);
+  const char* in = buffer.data() + kHeaderSize;
+  bool is_zero = true;
+  for (size_t i = 0; i < count; ++i, in += 2) {
+    result.num_[i] = static_cast<int>(ReadLe(in, 2));
+    if (result.num_[i] >= kBase) {
+      throw std::runtime_error("BigInteger: limb out of range");
+    }
+    is_zero = is_zero && result.num_[i] == 0;
+  }
+  if (is_zero != (result.sign_ == Sign::zero)) {
+    throw std::runtime_error("BigInteger: sign does not match limbs");
+  }
+  buffer = buffer.subspan(kHeaderSize + 2 * count);
+  result.DeleteZeroes();
+  return result;
+}
+
+BigInteger BigInteger::ReadBody(std::istream& input) {
+  char header[kHeaderSize];
+  if (!input.read(header, kHeaderSize)) {
+    throw std::runtime_error("BigInteger: truncated header");
+  }
+  size_t count = ReadLe(header + 1, 4);
+  // The count is untrusted, so the buffer only grows as the limbs arrive
+  const size_t kChunk = 1 << 16;
+  std::vector<char> body(header, header + kHeaderSize);
+  for (size_t left = 2 * count; left > 0;) {
+    size_t chunk = std::min(left, kChunk);
+    size_t offset = body.size();
+    body.resize(offset + chunk);
+    if (!input.read(body.data() + offset, chunk)) {
+      throw std::runtime_error("BigInteger: truncated limbs");
+    }
+    left -= chunk;
+  }
+  std::span<const char> view(body);
+  return ReadBody(view);
+}
+
+size_t BigInteger::serializedSize() const { return 1 + BodySize(); }
+
+void BigInteger::serialize(std::ostream& output) const {
+  std::vector<char> buffer(serializedSize());
+  serialize(buffer);
+  output.write(buffer.data(), buffer.size());
+}
+
+size_t BigInteger::serialize(std::span<char> buffer) const {
+  if (buffer.size() < serializedSize()) {
+    throw std::length_error("BigInteger: buffer is too small");
+  }
+  buffer[0] = static_cast<char>(kSerialVersion);
+  WriteBody(buffer.data() + 1);
+  return serializedSize();
+}
+
+BigInteger BigInteger::deserialize(std::istream& input) {
+  char version;
+  if (!input.get(version) || static_cast<uint8_t>(version) != kSerialVersion) {
+    throw std::runtime_error("BigInteger: unsupported format version");
+  }
+  return ReadBody(input);
+}
+
+BigInteger BigInteger::deserialize(std::span<const char>& buffer) {
+  if (buffer.empty() || static_cast<uint8_t>(buffer[0]) != kSerialVersion) {
+    throw std::runtime_error("BigInteger: unsupported format version");
+  }
+  std::span<const char> rest = buffer.subspan(1);
+  BigInteger result = ReadBody(rest);
+  buffer = rest;
+  return result;
+}
+
+size_t BigInteger::hash() const {
+  size_t hash = hash_.load(std::memory_order_relaxed);
+  if (hash == 0) {
+    // Limbs are below 2^16, so four of them are packed into one word per round
+    uint64_t result = 0x9E3779B97F4A7C15ULL ^ num_.size();
+    for (size_t i = 0; i < num_.size(); i += 4) {
+      uint64_t word = 0;
+      for (size_t j = i; j < num_.size() && j < i + 4; ++j) {
+        word |= static_cast<uint64_t>(num_[j]) << (16 * (j - i));
+      }
+      result = Mix(result ^ word);
+    }
+    hash = (result == 0 ? 1 : result);
+    hash_.store(hash, std::memory_order_relaxed);
+  }
+  return Mix(hash + static_cast<uint64_t>(sign_));
+}
+
 class Rational {
   static const int default_precision = 15;
  private:
@@ -445,6 +944,7 @@ class Rational {
     second.swap(buffer);
   }
   BigInteger gcd(BigInteger& first, BigInteger& second) {
+    BIGINTEGER_PROFILE(gcd, std::max(first.num_.size(), second.num_.size()));
     while (second > 0) {
       first %= second;
       swap(first, second);
@@ -458,6 +958,22 @@ class Rational {
     numerator_ /= buf;
     denominator_ /= buf;
   }
+  // Equality and hashing compare the parts directly, so decoded values
+  // must already be in lowest terms with a positive denominator. The gcd
+  // is expensive, so lowest terms are only checked on request
+  void CheckCanonical(bool validate) {
+    if (denominator_.sign_ != BigInteger::Sign::plus) {
+      throw std::runtime_error("Rational: non-positive denominator");
+    }
+    if (!validate) {
+      return;
+    }
+    BigInteger clone_denom = denominator_;
+    BigInteger clone_numer = (numerator_ > 0) ? numerator_ : -numerator_;
+    if (gcd(clone_numer, clone_denom) != 1) {
+      throw std::runtime_error("Rational: fraction is not in lowest terms");
+    }
+  }
   void swap(Rational& other) {
     std::swap(numerator_, other.numerator_);
     std::swap(denominator_, other.denominator_);
@@ -489,6 +1005,16 @@ class Rational {
   std::string asDecimal(size_t precision) const;
 
   explicit operator double() const;
+
+  size_t serializedSize() const;
+  void serialize(std::ostream& output) const;
+  size_t serialize(std::span<char> buffer) const;
+  // Input is trusted to come from serialize() unless validate is set, in
+  // which case fractions not in lowest terms are rejected too
+  static Rational deserialize(std::istream& input, bool validate = false);
+  static Rational deserialize(std::span<const char>& buffer, bool validate = false);
+
+  size_t hash() const;
 };
 
 Rational::Rational() : Rational(0) {}
@@ -642,3 +1168,128 @@ Rational operator/(const Rational& first, const Rational& second) {
   result /= second;
   return result;
 }
+
+
+size_t Rational::serializedSize() const {
+  return 1 + numerator_.BodySize() + denominator_.BodySize();
+}
+
+void Rational::serialize(std::ostream& output) const {
+  std::vector<char> buffer(serializedSize());
+  serialize(buffer);
+  output.write(buffer.data(), buffer.size());
+}
+
+size_t Rational::serialize(std::span<char> buffer) const {
+  if (buffer.size() < serializedSize()) {
+    throw std::length_error("Rational: buffer is too small");
+  }
+  buffer[0] = static_cast<char>(BigInteger::kSerialVersion);
+  denominator_.WriteBody(numerator_.WriteBody(buffer.data() + 1));
+  return serializedSize();
+}
+
+Rational Rational::deserialize(std::istream& input, bool validate) {
+  char version;
+  if (!input.get(version) ||
+      static_cast<uint8_t>(version) != BigInteger::kSerialVersion) {
+    throw std::runtime_error("Rational: unsupported format version");
+  }
+  Rational result;
+  result.numerator_ = BigInteger::ReadBody(input);
+  result.denominator_ = BigInteger::ReadBody(input);
+  result.CheckCanonical(validate);
+  return result;
+}
+
+Rational Rational::deserialize(std::span<const char>& buffer, bool validate) {
+  if (buffer.empty() ||
+      static_cast<uint8_t>(buffer[0]) != BigInteger::kSerialVersion) {
+    throw std::runtime_error("Rational: unsupported format version");
+  }
+  std::span<const char> rest = buffer.subspan(1);
+  Rational result;
+  result.numerator_ = BigInteger::ReadBody(rest);
+  result.denominator_ = BigInteger::ReadBody(rest);
+  result.CheckCanonical(validate);
+  buffer = rest;
+  return result;
+}
+
+size_t Rational::hash() const {
+  // Values are kept normalized, so equal rationals have equal parts
+  return BigInteger::Mix(numerator_.hash() ^ (denominator_.hash() * 0x9E3779B97F4A7C15ULL));
+}
+
+template <>
+struct std::hash<BigInteger> {
+  size_t operator()(const BigInteger& value) const { return value.hash(); }
+};
+
+template <>
+struct std::hash<Rational> {
+  size_t operator()(const Rational& value) const { return value.hash(); }
+};
+
+// Vector file: "BIGV" magic, u64 LE count, then serialized values back to back
+void serializeAll(std::ostream& output, const std::vector<BigInteger>& values) {
+  char header[12] = {'B', 'I', 'G', 'V'};
+  for (size_t i = 0; i < 8; ++i) {
+    header[4 + i] = static_cast<char>((static_cast<uint64_t>(values.size()) >> (8 * i)) & 0xFF);
+  }
+  output.write(header, sizeof(header));
+  for (const BigInteger& value : values) {
+    value.serialize(output);
+  }
+}
+
+std::vector<BigInteger> deserializeAll(std::span<const char> buffer) {
+  if (buffer.size() < 12 || std::string(buffer.data(), 4) != "BIGV") {
+    throw std::runtime_error("BigInteger: bad vector header");
+  }
+  uint64_t count = 0;
+  for (size_t i = 0; i < 8; ++i) {
+    count |= static_cast<uint64_t>(static_cast<unsigned char>(buffer[4 + i])) << (8 * i);
+  }
+  buffer = buffer.subspan(12);
+  std::vector<BigInteger> result;
+  result.reserve(std::min<uint64_t>(count, buffer.size() / 6));
+  for (uint64_t i = 0; i < count; ++i) {
+    result.push_back(BigInteger::deserialize(buffer));
+  }
+  return result;
+}
+
+std::vector<BigInteger> loadBigIntegers(const std::string& path) {
+#if __has_include(<sys/mman.h>)
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::runtime_error("BigInteger: cannot open " + path);
+  }
+  struct stat info;
+  if (fstat(fd, &info) == -1 || info.st_size == 0) {
+    close(fd);
+    throw std::runtime_error("BigInteger: cannot map " + path);
+  }
+  void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error("BigInteger: cannot map " + path);
+  }
+  madvise(data, info.st_size, MADV_SEQUENTIAL);
+  try {
+    std::vector<BigInteger> result = deserializeAll(
+        std::span<const char>(static_cast<const char*>(data), info.st_size));
+    munmap(data, info.st_size);
+    return result;
+  } catch (...) {
+    munmap(data, info.st_size);
+    throw;
+  }
+#else
+  std::ifstream input(path, std::ios::binary);
+  std::vector<char> buffer((std::istreambuf_iterator<char>(input)),
+                           std::istreambuf_iterator<char>());
+  return deserializeAll(buffer);
+#endif
+}
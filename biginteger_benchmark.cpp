@@ -0,0 +1,160 @@
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "biginteger.h"
+
+// Usage: biginteger_benchmark [--max-digits=N] [--min-time=SECONDS]
+//                             [--filter=SUBSTRING] [--json]
+// Every operand is generated from a fixed seed, so runs are comparable
+// between builds and the JSON output can be diffed to spot regressions.
+
+namespace Bench {
+  const uint64_t kSeed = 20240601;
+
+  struct Options {
+    size_t max_digits = 1000;
+    double min_time = 0.2;
+    std::string filter;
+    bool json = false;
+  };
+
+  struct Result {
+    std::string name;
+    size_t digits;
+    size_t iterations;
+    double ns_per_op;
+  };
+
+  template <typename T>
+  void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  std::string RandomDigits(std::mt19937_64& gen, size_t digits) {
+    std::uniform_int_distribution<int> digit(0, 9);
+    std::string result(digits, '0');
+    for (char& sym : result) {
+      sym = static_cast<char>('0' + digit(gen));
+    }
+    result[0] = static_cast<char>('1' + digit(gen) % 9);
+    return result;
+  }
+
+  BigInteger RandomBig(std::mt19937_64& gen, size_t digits) {
+    return BigInteger(RandomDigits(gen, digits));
+  }
+
+  BigInteger Gcd(BigInteger first, BigInteger second) {
+    while (second > 0) {
+      first %= second;
+      first.swap(second);
+    }
+    return first;
+  }
+
+  // Doubles the iteration count until one batch runs for at least min_time
+  Result Measure(const Options& options, const std::string& name, size_t digits,
+                 const std::function<void()>& body) {
+    size_t iterations = 1;
+    while (true) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < iterations; ++i) {
+        body();
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      if (elapsed.count() >= options.min_time || iterations >= (1ULL << 30)) {
+        return {name, digits, iterations, elapsed.count() * 1e9 / iterations};
+      }
+      size_t next = iterations * 2;
+      if (elapsed.count() > 0) {
+        next = std::max<size_t>(next, iterations * options.min_time / elapsed.count() * 1.2);
+      }
+      iterations = next;
+    }
+  }
+
+  std::vector<Result> RunAll(const Options& options) {
+    std::vector<Result> results;
+    auto run = [&](const std::string& name, size_t digits, const std::function<void()>& body) {
+      if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+        return;
+      }
+      results.push_back(Measure(options, name, digits, body));
+      if (!options.json) {
+        const Result& last = results.back();
+        std::cout << std::left << std::setw(20) << last.name << std::right << std::setw(10)
+                  << last.digits << std::setw(16) << std::fixed << std::setprecision(1)
+                  << last.ns_per_op << " ns" << std::setw(12) << last.iterations << '\n';
+      }
+    };
+
+    for (size_t digits = 4; digits <= options.max_digits; digits *= 10) {
+      std::mt19937_64 gen(kSeed + digits);
+      BigInteger first = RandomBig(gen, digits);
+      BigInteger second = RandomBig(gen, digits);
+      BigInteger wide = RandomBig(gen, 2 * digits);
+      std::string text = first.toString();
+
+      run("add", digits, [&] { DoNotOptimize(first + second); });
+      run("sub", digits, [&] { DoNotOptimize(first - second); });
+      run("mul", digits, [&] { DoNotOptimize(first * second); });
+      run("div", digits, [&] { DoNotOptimize(wide / first); });
+      run("mod", digits, [&] { DoNotOptimize(wide % first); });
+      run("toString", digits, [&] { DoNotOptimize(first.toString()); });
+      run("parse", digits, [&] { DoNotOptimize(BigInteger(text)); });
+      run("gcd", digits, [&] { DoNotOptimize(Gcd(first, second)); });
+
+      Rational left = Rational(first) / Rational(RandomBig(gen, digits));
+      Rational right = Rational(second) / Rational(RandomBig(gen, digits));
+      run("rational_add", digits, [&] { DoNotOptimize(left + right); });
+      run("rational_compare", digits, [&] { DoNotOptimize(left < right); });
+      run("rational_asDecimal", digits, [&] { DoNotOptimize(left.asDecimal(digits)); });
+    }
+    return results;
+  }
+
+  void PrintJson(const std::vector<Result>& results) {
+    std::cout << "{\n  \"seed\": " << kSeed << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+      std::cout << "    {\"name\": \"" << results[i].name << "\", \"digits\": " << results[i].digits
+                << ", \"iterations\": " << results[i].iterations << ", \"ns_per_op\": "
+                << std::fixed << std::setprecision(2) << results[i].ns_per_op << "}"
+                << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    std::cout << "  ]\n}\n";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  Bench::Options options;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--max-digits=", 13) == 0) {
+      options.max_digits = std::stoull(argv[i] + 13);
+    } else if (strncmp(argv[i], "--min-time=", 11) == 0) {
+      options.min_time = std::stod(argv[i] + 11);
+    } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+      options.filter = argv[i] + 9;
+    } else if (strcmp(argv[i], "--json") == 0) {
+      options.json = true;
+    } else {
+      std::cerr << "unknown option " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  if (!options.json) {
+    std::cout << std::left << std::setw(20) << "benchmark" << std::right << std::setw(10)
+              << "digits" << std::setw(19) << "time/op" << std::setw(12) << "iterations"
+              << '\n';
+  }
+  std::vector<Bench::Result> results = Bench::RunAll(options);
+  if (options.json) {
+    Bench::PrintJson(results);
+  }
+}
@@ -1,27 +1,70 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-template <typename T>
+// Elements per block: about kBlockBytes worth of T, but at least 16, unless
+// BlockSize overrides it. Shared by Deque and the queues built on its layout.
+template <typename T, size_t BlockSize>
+constexpr size_t DequeBlockSize() {
+  constexpr size_t kBlockBytes = 4096;
+  return BlockSize != 0 ? BlockSize
+                        : std::bit_floor(std::max<size_t>(16, kBlockBytes / sizeof(T)));
+}
+
+// Elements live in blocks of kInterSize (see DequeBlockSize).
+// Blocks and the block map both come from Alloc via allocator_traits, so
+// over-aligned T and custom allocators (e.g. StackAllocator) are honoured.
+// The size is always a power of two, so positions split into a block
+// number and an offset with a shift and a mask.
+template <typename T, typename Alloc = std::allocator<T>, size_t BlockSize = 0>
 class Deque {
-  static const int64_t kInterSize = 16;
+  using AllocTraits = std::allocator_traits<Alloc>;
+  using MapAlloc = typename AllocTraits::template rebind_alloc<T*>;
+  using Map = std::vector<T*, MapAlloc>;
+
+  static constexpr int64_t kInterSize = DequeBlockSize<T, BlockSize>();
+  static constexpr int64_t kShift = std::countr_zero(static_cast<uint64_t>(kInterSize));
+  static constexpr int64_t kMask = kInterSize - 1;
+  static_assert(std::has_single_bit(static_cast<uint64_t>(kInterSize)),
+                "Deque block size must be a power of two");
 
  public:
+  // Holds the current element, the bounds of its block and the map slot
+  // of that block, so stepping is a pointer bump and only crossing into
+  // another block touches the map
   template <bool isConstant>
   class DequeIterator {
    private:
-    using inside_iter =
-    typename std::conditional<isConstant,
-                              typename std::vector<T*>::const_iterator,
-                              typename std::vector<T*>::iterator>::type;
-
-    int64_t block_;
-    int64_t index_;
-    inside_iter begin_;
-    T* value_;
+    T* cur_;
+    T* first_;
+    T* last_;
+    T* const* node_;
 
-    void upd_val_ptr() { value_ = begin_[block_] + index_; }
+    void set_node(T* const* node) {
+      node_ = node;
+      first_ = *node;
+      last_ = first_ + kInterSize;
+    }
 
    public:
     friend class Deque;
@@ -32,71 +75,67 @@ class Deque {
     using difference_type = std::ptrdiff_t;
     using iterator_category = std::random_access_iterator_tag;
 
-    DequeIterator() : block_(0), index_(0), begin_(), value_(nullptr) {}
-    DequeIterator(int64_t block, int64_t index, inside_iter begin)
-        : block_(block),
-          index_(index),
-          begin_(begin),
-          value_(begin[block_] + index_) {}
-    DequeIterator(const DequeIterator& other)
-        : block_(other.block_),
-          index_(other.index_),
-          begin_(other.begin_),
-          value_(other.value_) {}
-    DequeIterator& operator=(const DequeIterator& other) {
-      DequeIterator<false> copy(other);
-      std::swap(block_, copy.block_);
-      std::swap(index_, copy.index_);
-      std::swap(begin_, copy.begin_);
-      std::swap(value_, copy.value_);
-      return *this;
-    }
-    operator DequeIterator<true>() {
-      return DequeIterator<true>(block_, index_, begin_);
+    DequeIterator() : cur_(nullptr), first_(nullptr), last_(nullptr), node_(nullptr) {}
+    DequeIterator(T* const* node, T* cur)
+        : cur_(cur), first_(*node), last_(*node + kInterSize), node_(node) {}
+
+    operator DequeIterator<true>() const {
+      DequeIterator<true> result;
+      result.cur_ = cur_;
+      result.first_ = first_;
+      result.last_ = last_;
+      result.node_ = node_;
+      return result;
     }
 
     DequeIterator<false> remove_const() const {
-      return DequeIterator<false>(block_, index_, begin_);
+      DequeIterator<false> result;
+      result.cur_ = cur_;
+      result.first_ = first_;
+      result.last_ = last_;
+      result.node_ = node_;
+      return result;
     }
 
     DequeIterator& operator+=(ptrdiff_t diff) {
-      int64_t pos = block_ * kInterSize + index_;
-      pos += diff;
-      index_ = pos % kInterSize;
-      block_ = pos / kInterSize;
-      upd_val_ptr();
+      ptrdiff_t offset = diff + (cur_ - first_);
+      if (offset >= 0 && offset < kInterSize) {
+        cur_ += diff;
+        return *this;
+      }
+      set_node(node_ + (offset >> kShift));
+      cur_ = first_ + (offset & kMask);
       return *this;
     }
 
-    DequeIterator& operator-=(ptrdiff_t diff) {
-      *this += -diff;
-      upd_val_ptr();
-      return *this;
-    }
+    DequeIterator& operator-=(ptrdiff_t diff) { return *this += -diff; }
 
     DequeIterator& operator++() {
-      *this += 1;
-      upd_val_ptr();
+      if (++cur_ == last_) {
+        set_node(node_ + 1);
+        cur_ = first_;
+      }
       return *this;
     }
 
     DequeIterator& operator--() {
-      *this -= 1;
-      upd_val_ptr();
+      if (cur_ == first_) {
+        set_node(node_ - 1);
+        cur_ = last_;
+      }
+      --cur_;
       return *this;
     }
 
     DequeIterator operator++(int) {
       DequeIterator copy = *this;
-      *this += 1;
-      upd_val_ptr();
+      ++*this;
       return copy;
     }
 
     DequeIterator operator--(int) {
       DequeIterator copy = *this;
-      *this -= 1;
-      upd_val_ptr();
+      --*this;
       return copy;
     }
 
@@ -112,36 +151,34 @@ class Deque {
       return copy;
     }
 
+    friend DequeIterator operator+(ptrdiff_t diff, const DequeIterator& iter) {
+      return iter + diff;
+    }
+
     ptrdiff_t operator-(const DequeIterator& other) const {
-      return (block_ - other.block_) * kInterSize + index_ - other.index_;
+      return ((node_ - other.node_) << kShift) + (cur_ - first_) -
+             (other.cur_ - other.first_);
     }
 
     bool operator<(const DequeIterator& other) const {
-      return (block_ * kInterSize + index_) <
-          (other.block_ * kInterSize + other.index_);
+      return node_ == other.node_ ? cur_ < other.cur_ : node_ < other.node_;
     }
 
     bool operator>(const DequeIterator& other) const { return other < *this; }
 
-    bool operator==(const DequeIterator& other) const {
-      return !(*this < other || other < *this);
-    }
+    bool operator==(const DequeIterator& other) const { return cur_ == other.cur_; }
 
-    bool operator!=(const DequeIterator& other) const {
-      return !(*this == other);
-    }
+    bool operator!=(const DequeIterator& other) const { return cur_ != other.cur_; }
 
-    bool operator<=(const DequeIterator& other) const {
-      return *this < other || *this == other;
-    }
+    bool operator<=(const DequeIterator& other) const { return !(other < *this); }
 
-    bool operator>=(const DequeIterator& other) const {
-      return *this > other || *this == other;
-    }
+    bool operator>=(const DequeIterator& other) const { return !(*this < other); }
 
-    reference operator*() const { return *value_; }
+    reference operator*() const { return *cur_; }
 
-    pointer operator->() const { return value_; }
+    pointer operator->() const { return cur_; }
+
+    reference operator[](ptrdiff_t diff) const { return *(*this + diff); }
   };
 
   using iterator = DequeIterator<false>;
@@ -149,86 +186,104 @@ class Deque {
   using reverse_iterator = std::reverse_iterator<iterator>;
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
-  Deque() : start_(0), size_(0), outer_(1) {
-    outer_[0] = reinterpret_cast<T*>(new char[kInterSize * sizeof(T)]);
+  Deque() : Deque(Alloc()) {}
+
+  explicit Deque(const Alloc& alloc)
+      : alloc_(alloc), start_(0), size_(0), outer_(MapAlloc(alloc_)) {}
+
+  explicit Deque(size_t size, const Alloc& alloc = Alloc()) : Deque(alloc) {
+    fill_init(size, [this](T* place, size_t) { AllocTraits::construct(alloc_, place); });
   }
 
-  explicit Deque(size_t size)
-      : start_(0), size_(size), outer_(size / kInterSize + 1) {
-    for (size_t i = 0; i < outer_.size(); ++i) {
-      outer_[i] = reinterpret_cast<T*>(new char[kInterSize * sizeof(T)]);
-    }
-    size_t counter = 0;
-    try {
-      for (size_t i = 0; i < size; ++i) {
-        new(outer_[i / kInterSize] + i % kInterSize) T();
-        ++counter;
-      }
-    } catch (...) {
-      for (size_t i = 0; i < counter; ++i) {
-        (outer_[i / kInterSize] + i % kInterSize)->~T();
-      }
-      size_ = 0;
-      throw;
-    }
+  Deque(size_t size, const T& value, const Alloc& alloc = Alloc()) : Deque(alloc) {
+    fill_init(size, [this, &value](T* place, size_t) {
+      AllocTraits::construct(alloc_, place, value);
+    });
   }
-  Deque(size_t size, const T& value)
-      : start_(0), size_(size), outer_(size / kInterSize + 1) {
-    for (size_t i = 0; i < outer_.size(); ++i) {
-      outer_[i] = reinterpret_cast<T*>(new char[kInterSize * sizeof(T)]);
-    }
-    size_t counter = 0;
-    try {
-      for (size_t i = 0; i < size; ++i) {
-        new(outer_[i / kInterSize] + i % kInterSize) T(value);
-        ++counter;
-      }
-    } catch (...) {
-      for (size_t i = 0; i < counter; ++i) {
-        (outer_[i / kInterSize] + i % kInterSize)->~T();
-      }
-      size_ = 0;
-      throw;
-    }
+
+  template <std::input_iterator InputIt>
+  Deque(InputIt first, InputIt last, const Alloc& alloc = Alloc()) : Deque(alloc) {
+    append(first, last);
+  }
+
+  Deque(std::initializer_list<T> list, const Alloc& alloc = Alloc()) : Deque(alloc) {
+    append(list.begin(), list.end());
   }
 
   Deque(const Deque& other)
-      : start_(0), size_(other.size_), outer_(other.size_ / kInterSize + 1) {
-    for (size_t i = 0; i < outer_.size(); ++i) {
-      outer_[i] = reinterpret_cast<T*>(new char[kInterSize * sizeof(T)]);
-    }
-    size_t counter = 0;
-    try {
-      for (size_t i = 0; i < size_; ++i) {
-        new(outer_[i / kInterSize] + i % kInterSize) T(other[i]);
-        ++counter;
-      }
-    } catch (...) {
-      for (size_t i = 0; i < counter; ++i) {
-        (outer_[i / kInterSize] + i % kInterSize)->~T();
-      }
-      size_ = 0;
-      throw;
-    }
+      : Deque(other, AllocTraits::select_on_container_copy_construction(other.alloc_)) {}
+
+  Deque(const Deque& other, const Alloc& alloc) : Deque(alloc) {
+    fill_init(other.size_, [this, &other](T* place, size_t index) {
+      AllocTraits::construct(alloc_, place, other[index]);
+    });
+  }
+
+  Deque(Deque&& other) noexcept
+      : alloc_(std::move(other.alloc_)),
+        start_(other.start_),
+        size_(other.size_),
+        outer_(std::move(other.outer_)) {
+    other.start_ = 0;
+    other.size_ = 0;
+    other.outer_.clear();
   }
 
   ~Deque() {
     for (size_t i = 0; i < size_; ++i) {
-      (outer_[(start_ + i) / kInterSize] + (start_ + i) % kInterSize)->~T();
+      AllocTraits::destroy(alloc_, slot(start_ + i));
     }
-    for (size_t i = 0; i < outer_.size(); ++i) {
-      delete[] reinterpret_cast<char*>(outer_[i]);
+    for (T* block : outer_) {
+      if (block != nullptr) {
+        AllocTraits::deallocate(alloc_, block, kInterSize);
+      }
     }
   }
 
   Deque& operator=(const Deque& other) {
-    Deque copy(other);
-    std::swap(start_, copy.start_);
-    std::swap(size_, copy.size_);
-    std::swap(outer_, copy.outer_);
+    if (this == &other) {
+      return *this;
+    }
+    Deque copy(other, AllocTraits::propagate_on_container_copy_assignment::value
+                          ? other.alloc_
+                          : alloc_);
+    swap_all(copy);
     return *this;
   }
 
+  Deque& operator=(Deque&& other) noexcept(
+      AllocTraits::propagate_on_container_move_assignment::value ||
+      AllocTraits::is_always_equal::value) {
+    if constexpr (AllocTraits::propagate_on_container_move_assignment::value ||
+                  AllocTraits::is_always_equal::value) {
+      Deque copy(std::move(other));
+      swap_all(copy);
+    } else {
+      // Blocks of another allocator cannot be adopted: move element-wise
+      Deque copy(alloc_);
+      if (alloc_ == other.alloc_) {
+        copy.swap_all(other);
+      } else {
+        for (T& value : other) {
+          copy.emplace_back(std::move(value));
+        }
+      }
+      swap_all(copy);
+    }
+    return *this;
+  }
+
+  void swap(Deque& other) noexcept {
+    if constexpr (AllocTraits::propagate_on_container_swap::value) {
+      std::swap(alloc_, other.alloc_);
+    }
+    std::swap(start_, other.start_);
+    std::swap(size_, other.size_);
+    outer_.swap(other.outer_);
+  }
+
+  Alloc get_allocator() const { return alloc_; }
+
   T& operator[](size_t index) {
     index += start_;
     return outer_[index / kInterSize][index % kInterSize];
@@ -255,59 +310,54 @@ class Deque {
 
   [[nodiscard]] size_t size() const { return size_; }
 
-  void push_back(const T& value) {
-    if (start_ + size_ == outer_.size() * kInterSize) {
-      reallocate();
-    }
-    try {
-      new(outer_[(start_ + size_) / kInterSize] +
-          (start_ + size_) % kInterSize) T(value);
-    } catch (...) {
-      throw;
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (start_ + size_ + 1 == outer_.size() * kInterSize || outer_.empty()) {
+      reallocate(0, 1);
     }
+    slot(start_ + size_ + 1, true);
+    T* place = slot(start_ + size_, true);
+    AllocTraits::construct(alloc_, place, std::forward<Args>(args)...);
     ++size_;
+    return *place;
   }
 
+  void push_back(const T& value) { emplace_back(value); }
+
+  void push_back(T&& value) { emplace_back(std::move(value)); }
+
   void pop_back() {
-    (outer_[(start_ + size_ - 1) / kInterSize] + (size_ - 1) % kInterSize)
-        ->~T();
+    AllocTraits::destroy(alloc_, slot(start_ + size_ - 1));
     --size_;
   }
 
-  void push_front(const T& value) {
-    if (start_ == 0) {
-      reallocate();
-    }
-
-    try {
-      new(outer_[(start_ - 1) / kInterSize] + (start_ - 1) % kInterSize)
-          T(value);
-    } catch (...) {
-      throw;
+  template <typename... Args>
+  T& emplace_front(Args&&... args) {
+    if (start_ == 0 || outer_.empty()) {
+      reallocate(1, 0);
     }
+    T* place = slot(start_ - 1, true);
+    AllocTraits::construct(alloc_, place, std::forward<Args>(args)...);
     --start_;
     ++size_;
+    return *place;
   }
 
+  void push_front(const T& value) { emplace_front(value); }
+
+  void push_front(T&& value) { emplace_front(std::move(value)); }
+
   void pop_front() {
-    (outer_[start_ / kInterSize] + start_ % kInterSize)->~T();
+    AllocTraits::destroy(alloc_, slot(start_));
     ++start_;
     --size_;
   }
 
-  iterator begin() {
-    return iterator(start_ / kInterSize, start_ % kInterSize, outer_.begin());
-  }
+  iterator begin() { return make_iterator<false>(start_); }
 
-  const_iterator begin() const {
-    return const_iterator(start_ / kInterSize, start_ % kInterSize,
-                          outer_.begin());
-  }
+  const_iterator begin() const { return make_iterator<true>(start_); }
 
-  const_iterator cbegin() const {
-    return const_iterator(start_ / kInterSize, start_ % kInterSize,
-                          outer_.begin());
-  }
+  const_iterator cbegin() const { return make_iterator<true>(start_); }
 
   reverse_iterator rbegin() { return std::reverse_iterator(end()); }
 
@@ -319,20 +369,11 @@ class Deque {
     return std::reverse_iterator(cend());
   }
 
-  iterator end() {
-    return iterator((start_ + size_) / kInterSize,
-                    (start_ + size_) % kInterSize, outer_.begin());
-  }
+  iterator end() { return make_iterator<false>(start_ + size_); }
 
-  const_iterator end() const {
-    return const_iterator((start_ + size_) / kInterSize,
-                          (start_ + size_) % kInterSize, outer_.begin());
-  }
+  const_iterator end() const { return make_iterator<true>(start_ + size_); }
 
-  const_iterator cend() const {
-    return const_iterator((start_ + size_) / kInterSize,
-                          (start_ + size_) % kInterSize, outer_.begin());
-  }
+  const_iterator cend() const { return make_iterator<true>(start_ + size_); }
 
   reverse_iterator rend() { return std::reverse_iterator(begin()); }
 
@@ -343,65 +384,1052 @@ class Deque {
   const_reverse_iterator crend() const {
     return std::reverse_iterator(cbegin());
   }
-  void insert(iterator iter, const T& value) {
-    if (iter == begin()) {
-      push_front(value);
+
+  // Iterates over the contiguous pieces of the deque (one per block) as
+  // spans, so hot loops can run over plain arrays
+  template <bool isConstant>
+  class SegmentRange {
+   private:
+    using value_pointer = typename std::conditional<isConstant, const T*, T*>::type;
+    using deque_pointer = typename std::conditional<isConstant, const Deque*, Deque*>::type;
+
+    deque_pointer deque_;
+
+   public:
+    class SegmentIterator {
+     private:
+      deque_pointer deque_;
+      size_t block_;
+
+     public:
+      using value_type = std::span<typename std::conditional<isConstant, const T, T>::type>;
+      using difference_type = std::ptrdiff_t;
+      using iterator_category = std::forward_iterator_tag;
+
+      SegmentIterator(deque_pointer deque, size_t block) : deque_(deque), block_(block) {}
+
+      value_type operator*() const {
+        size_t first = std::max(deque_->start_, block_ * kInterSize);
+        size_t last = std::min(deque_->start_ + deque_->size_, (block_ + 1) * kInterSize);
+        return value_type(static_cast<value_pointer>(deque_->slot(first)), last - first);
+      }
+
+      SegmentIterator& operator++() {
+        ++block_;
+        return *this;
+      }
+
+      SegmentIterator operator++(int) {
+        SegmentIterator copy = *this;
+        ++block_;
+        return copy;
+      }
+
+      bool operator==(const SegmentIterator& other) const { return block_ == other.block_; }
+
+      bool operator!=(const SegmentIterator& other) const { return block_ != other.block_; }
+    };
+
+    explicit SegmentRange(deque_pointer deque) : deque_(deque) {}
+
+    SegmentIterator begin() const {
+      return SegmentIterator(deque_, deque_->start_ / kInterSize);
+    }
+
+    SegmentIterator end() const {
+      if (deque_->size_ == 0) {
+        return begin();
+      }
+      return SegmentIterator(deque_, (deque_->start_ + deque_->size_ - 1) / kInterSize + 1);
+    }
+  };
+
+  SegmentRange<false> segments() { return SegmentRange<false>(this); }
+
+  SegmentRange<true> segments() const { return SegmentRange<true>(this); }
+
+  template <typename Callback>
+  void for_each_segment(Callback callback) {
+    for (std::span<T> segment : segments()) {
+      callback(segment.data(), segment.size());
+    }
+  }
+
+  template <typename Callback>
+  void for_each_segment(Callback callback) const {
+    for (std::span<const T> segment : segments()) {
+      callback(segment.data(), segment.size());
+    }
+  }
+  template <typename... Args>
+  iterator emplace(const_iterator citer, Args&&... args) {
+    size_t index = citer - cbegin();
+    if (index == 0) {
+      emplace_front(std::forward<Args>(args)...);
+      return begin();
+    }
+    if (index == size_) {
+      emplace_back(std::forward<Args>(args)...);
+      return end() - 1;
+    }
+    // Build the value first: args may refer to an element that is shifted.
+    // Only the shorter side of the deque is moved by one position.
+    T value(std::forward<Args>(args)...);
+    if (index < size_ / 2) {
+      emplace_front(std::move(front()));
+      std::move(begin() + 2, begin() + index + 1, begin() + 1);
+    } else {
+      emplace_back(std::move(back()));
+      std::move_backward(begin() + index, end() - 2, end() - 1);
+    }
+    iterator iter = begin() + index;
+    *iter = std::move(value);
+    return iter;
+  }
+
+  iterator insert(const_iterator iter, const T& value) { return emplace(iter, value); }
+
+  iterator insert(const_iterator iter, T&& value) {
+    return emplace(iter, std::move(value));
+  }
+
+  iterator erase(const_iterator citer) { return erase(citer, citer + 1); }
+
+  // Every surviving element on the shorter side is moved exactly once
+  iterator erase(const_iterator cfirst, const_iterator clast) {
+    size_t index = cfirst - cbegin();
+    size_t count = clast - cfirst;
+    if (count == 0) {
+      return begin() + index;
+    }
+    if (index < size_ - index - count) {
+      std::move_backward(begin(), begin() + index, begin() + index + count);
+      for (size_t i = 0; i < count; ++i) {
+        pop_front();
+      }
+    } else {
+      std::move(begin() + index + count, end(), begin() + index);
+      for (size_t i = 0; i < count; ++i) {
+        pop_back();
+      }
+    }
+    return begin() + index;
+  }
+
+  template <std::input_iterator InputIt>
+  iterator insert(const_iterator citer, InputIt first, InputIt last) {
+    size_t index = citer - cbegin();
+    if constexpr (std::forward_iterator<InputIt>) {
+      size_t count = std::distance(first, last);
+      if (index < size_ / 2) {
+        grow_front(count, [this, &first](T* place) {
+          AllocTraits::construct(alloc_, place, *first);
+          ++first;
+        });
+        std::rotate(begin(), begin() + count, begin() + count + index);
+        return begin() + index;
+      }
+    }
+    size_t old_size = size_;
+    append(first, last);
+    std::rotate(begin() + index, begin() + old_size, end());
+    return begin() + index;
+  }
+
+  iterator insert(const_iterator citer, size_t count, const T& value) {
+    size_t index = citer - cbegin();
+    if (index < size_ / 2) {
+      grow_front(count, [this, &value](T* place) {
+        AllocTraits::construct(alloc_, place, value);
+      });
+      std::rotate(begin(), begin() + count, begin() + count + index);
+      return begin() + index;
+    }
+    size_t old_size = size_;
+    resize(size_ + count, value);
+    std::rotate(begin() + index, begin() + old_size, end());
+    return begin() + index;
+  }
+
+  iterator insert(const_iterator citer, std::initializer_list<T> list) {
+    return insert(citer, list.begin(), list.end());
+  }
+
+  template <typename Range>
+  void append_range(Range&& range) {
+    append(std::ranges::begin(range), std::ranges::end(range));
+  }
+
+  template <std::input_iterator InputIt>
+  void assign(InputIt first, InputIt last) {
+    destroy_all();
+    append(first, last);
+  }
+
+  void assign(size_t count, const T& value) {
+    destroy_all();
+    resize(count, value);
+  }
+
+  void assign(std::initializer_list<T> list) { assign(list.begin(), list.end()); }
+
+  void resize(size_t count) {
+    while (size_ > count) {
+      pop_back();
+    }
+    if (count > size_) {
+      reserve_slots(0, count - size_);
+    }
+    while (size_ < count) {
+      AllocTraits::construct(alloc_, slot(start_ + size_));
+      ++size_;
+    }
+  }
+
+  void resize(size_t count, const T& value) {
+    while (size_ > count) {
+      pop_back();
+    }
+    if (count > size_) {
+      reserve_slots(0, count - size_);
+    }
+    while (size_ < count) {
+      AllocTraits::construct(alloc_, slot(start_ + size_), value);
+      ++size_;
+    }
+  }
+
+  // Allocate the blocks for count more elements at one end, so that many
+  // pushes there do not touch the allocator or the map
+  void reserve_front(size_t count) { reserve_slots(count, 0); }
+
+  void reserve_back(size_t count) { reserve_slots(0, count); }
+
+  // Frees every block without elements and shrinks the map to the blocks
+  // in use, releasing what a past spike left behind
+  void shrink_to_fit() {
+    if (size_ == 0) {
+      release_all();
       return;
     }
-    if (iter == end()) {
-      push_back(value);
+    size_t first = start_ / kInterSize;
+    size_t last = (start_ + size_) / kInterSize;
+    Map compact(outer_.begin() + first, outer_.begin() + last + 1, MapAlloc(alloc_));
+    for (size_t i = 0; i < outer_.size(); ++i) {
+      if ((i < first || i > last) && outer_[i] != nullptr) {
+        AllocTraits::deallocate(alloc_, outer_[i], kInterSize);
+      }
+    }
+    start_ %= kInterSize;
+    outer_.swap(compact);
+  }
+
+  // Destroys all elements and frees all blocks but warm_blocks of them,
+  // which stay in a small map for the next pushes at either end
+  void clear(size_t warm_blocks = 0) {
+    destroy_all();
+    Map kept{MapAlloc(alloc_)};
+    for (size_t i = 0; i < outer_.size(); ++i) {
+      if (outer_[i] == nullptr) {
+        continue;
+      }
+      if (kept.size() < warm_blocks) {
+        kept.push_back(outer_[i]);
+      } else {
+        AllocTraits::deallocate(alloc_, outer_[i], kInterSize);
+      }
+      outer_[i] = nullptr;
+    }
+    if (kept.empty()) {
+      release_all();
       return;
     }
-    push_back(value);
-    reverse_iterator riter = std::reverse_iterator(iter);
-    for (reverse_iterator from = rbegin() + 1, to = rbegin(); from <= riter;
-         ++from, ++to) {
-      new(&(*to)) T(*from);
+    Map warm(2 * kept.size(), nullptr, MapAlloc(alloc_));
+    size_t offset = kept.size() / 2;
+    std::copy(kept.begin(), kept.end(), warm.begin() + offset);
+    // Middle of the kept range, so both ends have room before allocating
+    start_ = offset * kInterSize + kept.size() * kInterSize / 2;
+    outer_.swap(warm);
+  }
+
+  // Bytes held by the deque itself: allocated blocks plus the map
+  size_t memory_usage() const {
+    size_t blocks = std::count_if(outer_.begin(), outer_.end(),
+                                  [](T* block) { return block != nullptr; });
+    return blocks * kInterSize * sizeof(T) + outer_.capacity() * sizeof(T*);
+  }
+
+  T& front() { return (*this)[0]; }
+
+  const T& front() const { return (*this)[0]; }
+
+  T& back() { return (*this)[size_ - 1]; }
+
+  const T& back() const { return (*this)[size_ - 1]; }
+
+ private:
+  template <bool isConstant>
+  DequeIterator<isConstant> make_iterator(size_t pos) const {
+    if (outer_.empty()) {
+      return DequeIterator<isConstant>();
+    }
+    return DequeIterator<isConstant>(outer_.data() + pos / kInterSize, slot(pos));
+  }
+
+  T* slot(size_t pos) const { return outer_[pos / kInterSize] + pos % kInterSize; }
+
+  // Blocks are allocated on first use; slots of the map may stay empty
+  T* slot(size_t pos, bool allocate) {
+    T*& block = outer_[pos / kInterSize];
+    if (allocate && block == nullptr) {
+      block = AllocTraits::allocate(alloc_, kInterSize);
+    }
+    return block + pos % kInterSize;
+  }
+
+  // Invariant: unless the map is empty, the block holding the end position
+  // start_ + size_ exists, so end() never points into a missing block.
+  //
+  // Makes room for front more elements before start_ and back more after
+  // the end, allocating every block of that range up front
+  void reserve_slots(size_t front, size_t back) {
+    if (outer_.empty() || start_ < front ||
+        start_ + size_ + back >= outer_.size() * kInterSize) {
+      reallocate(front, back);
+    }
+    for (size_t block = (start_ - front) / kInterSize;
+         block <= (start_ + size_ + back) / kInterSize; ++block) {
+      slot(block * kInterSize, true);
     }
-    new(&(*iter)) T(value);
   }
 
-  void insert(const_iterator iter, const T& value) {
-    insert(iter.remove_const(), value);
+  // Builds elements from [first, last) after the end, filling one block at
+  // a time; forward ranges get all their blocks reserved in one step
+  template <typename InputIt>
+  void append(InputIt first, InputIt last) {
+    if constexpr (std::forward_iterator<InputIt>) {
+      size_t count = std::distance(first, last);
+      reserve_slots(0, count);
+      while (count > 0) {
+        size_t pos = start_ + size_;
+        size_t chunk = std::min<size_t>(count, kInterSize - pos % kInterSize);
+        T* place = slot(pos);
+        for (size_t i = 0; i < chunk; ++i, ++first) {
+          AllocTraits::construct(alloc_, place + i, *first);
+          ++size_;
+        }
+        count -= chunk;
+      }
+    } else {
+      for (; first != last; ++first) {
+        emplace_back(*first);
+      }
+    }
   }
 
-  void erase(const iterator& iter) {
-    if (iter == begin()) {
-      pop_front();
+  // Builds count elements in front of the first one, in order, with
+  // init(place); if one throws, those already built are destroyed
+  template <typename Init>
+  void grow_front(size_t count, Init init) {
+    if (count == 0) {
       return;
     }
-    if (iter == end() - 1) {
-      pop_back();
+    reserve_slots(count, 0);
+    size_t built = 0;
+    try {
+      for (; built < count; ++built) {
+        init(slot(start_ - count + built));
+      }
+    } catch (...) {
+      for (size_t i = 0; i < built; ++i) {
+        AllocTraits::destroy(alloc_, slot(start_ - count + i));
+      }
+      throw;
+    }
+    start_ -= count;
+    size_ += count;
+  }
+
+  void destroy_all() {
+    for (size_t i = 0; i < size_; ++i) {
+      AllocTraits::destroy(alloc_, slot(start_ + i));
+    }
+    size_ = 0;
+  }
+
+  // Frees every block and the map of an empty deque
+  void release_all() {
+    for (T* block : outer_) {
+      if (block != nullptr) {
+        AllocTraits::deallocate(alloc_, block, kInterSize);
+      }
+    }
+    Map(MapAlloc(alloc_)).swap(outer_);
+    start_ = 0;
+  }
+
+  // Called when one end hits the edge of the map. With enough slack the
+  // map is rotated in place so the used blocks sit in the middle and the
+  // spare blocks freed at the other end wrap around to be reused. Only
+  // when it is at least half full is a twice larger map allocated.
+  void reallocate(size_t front, size_t back) {
+    size_t first = start_ / kInterSize;
+    size_t last = outer_.empty() ? first : (start_ + size_) / kInterSize + 1;
+    size_t used = last - first;
+    size_t front_blocks = (front + kInterSize - 1) / kInterSize + 1;
+    size_t needed = used + front_blocks + (back + kInterSize - 1) / kInterSize + 1;
+    if (outer_.size() >= 2 * needed) {
+      size_t offset = front_blocks + (outer_.size() - needed) / 2;
+      size_t shift = (first + outer_.size() - offset) % outer_.size();
+      std::rotate(outer_.begin(), outer_.begin() + shift, outer_.end());
+      start_ = offset * kInterSize + start_ % kInterSize;
       return;
     }
 
-    iter->~T();
+    Map new_out(std::max(2 * outer_.size(), 2 * needed), nullptr, MapAlloc(alloc_));
+    size_t offset = front_blocks + (new_out.size() - needed) / 2;
+    std::copy(outer_.begin() + first, outer_.begin() + last, new_out.begin() + offset);
+    size_t before = offset;
+    size_t after = offset + used;
+    bool to_back = true;
+    for (size_t i = 0; i < outer_.size(); ++i) {
+      if ((i >= first && i < last) || outer_[i] == nullptr) {
+        continue;
+      }
+      if ((to_back && after < new_out.size()) || before == 0) {
+        new_out[after++] = outer_[i];
+      } else {
+        new_out[--before] = outer_[i];
+      }
+      to_back = !to_back;
+    }
+    start_ = offset * kInterSize + start_ % kInterSize;
+    outer_.swap(new_out);
+    slot(start_ + size_, true);
+  }
 
-    for (iterator from = iter + 1, to = iter; from != end(); ++from, ++to) {
-      new(&(*(to))) T(*from);
+  // Allocates the blocks for size elements up front and builds them with
+  // init(place, index); on failure everything built so far is released
+  template <typename Init>
+  void fill_init(size_t size, Init init) {
+    try {
+      outer_.assign(size / kInterSize + 1, nullptr);
+      for (size_t i = 0; i < outer_.size(); ++i) {
+        outer_[i] = AllocTraits::allocate(alloc_, kInterSize);
+      }
+      for (; size_ < size; ++size_) {
+        init(slot(size_), size_);
+      }
+    } catch (...) {
+      for (size_t i = 0; i < size_; ++i) {
+        AllocTraits::destroy(alloc_, slot(i));
+      }
+      for (T* block : outer_) {
+        if (block != nullptr) {
+          AllocTraits::deallocate(alloc_, block, kInterSize);
+        }
+      }
+      outer_.clear();
+      size_ = 0;
+      throw;
     }
+  }
 
-    (end() - 1)->~T();
-    --size_;
+  void swap_all(Deque& other) noexcept {
+    std::swap(alloc_, other.alloc_);
+    std::swap(start_, other.start_);
+    std::swap(size_, other.size_);
+    outer_.swap(other.outer_);
+  }
+
+  Alloc alloc_;
+  size_t start_;
+  size_t size_;
+  Map outer_;
+};
+
+// Segmented algorithms: each runs the inner loop over one contiguous block
+// at a time, which the compiler can vectorize, instead of going through
+// DequeIterator for every element
+
+template <typename T, typename Alloc, size_t BlockSize, typename OutputIt>
+OutputIt copy(const Deque<T, Alloc, BlockSize>& deque, OutputIt out) {
+  deque.for_each_segment([&out](const T* data, size_t count) {
+    out = std::copy(data, data + count, out);
+  });
+  return out;
+}
+
+template <typename T, typename Alloc, size_t BlockSize>
+void fill(Deque<T, Alloc, BlockSize>& deque, const T& value) {
+  deque.for_each_segment([&value](T* data, size_t count) {
+    std::fill(data, data + count, value);
+  });
+}
+
+template <typename T, typename Alloc, size_t BlockSize>
+typename Deque<T, Alloc, BlockSize>::const_iterator find(const Deque<T, Alloc, BlockSize>& deque,
+                                                         const T& value) {
+  size_t index = 0;
+  for (std::span<const T> segment : deque.segments()) {
+    const T* found = std::find(segment.data(), segment.data() + segment.size(), value);
+    index += found - segment.data();
+    if (found != segment.data() + segment.size()) {
+      return deque.cbegin() + index;
+    }
+  }
+  return deque.cend();
+}
+
+template <typename T, typename Alloc, size_t BlockSize>
+typename Deque<T, Alloc, BlockSize>::iterator find(Deque<T, Alloc, BlockSize>& deque,
+                                                   const T& value) {
+  const Deque<T, Alloc, BlockSize>& view = deque;
+  return find(view, value).remove_const();
+}
+
+template <typename T, typename Alloc, size_t BlockSize, typename U>
+U accumulate(const Deque<T, Alloc, BlockSize>& deque, U init) {
+  deque.for_each_segment([&init](const T* data, size_t count) {
+    init = std::accumulate(data, data + count, std::move(init));
+  });
+  return init;
+}
+
+template <typename T, typename Alloc, size_t BlockSize, typename OutputIt, typename UnaryOp>
+OutputIt transform(const Deque<T, Alloc, BlockSize>& deque, OutputIt out, UnaryOp op) {
+  deque.for_each_segment([&out, &op](const T* data, size_t count) {
+    out = std::transform(data, data + count, out, op);
+  });
+  return out;
+}
+
+template <typename T, typename Alloc, size_t BlockSize, typename UnaryOp>
+void transform(Deque<T, Alloc, BlockSize>& deque, UnaryOp op) {
+  deque.for_each_segment([&op](T* data, size_t count) {
+    std::transform(data, data + count, data, op);
+  });
+}
+
+// Unbounded single-producer/single-consumer queue laid out like Deque: a
+// chain of fixed-size blocks. One thread may push while another pops, with
+// no locks. Positions only grow; the producer publishes them through tail_
+// (release) and the consumer reads it (acquire). Fully consumed blocks go to
+// a free list from which the producer takes blocks before allocating new ones.
+template <typename T, typename Alloc = std::allocator<T>, size_t BlockSize = 0>
+class SpscDeque {
+  static constexpr size_t kInterSize = DequeBlockSize<T, BlockSize>();
+  static constexpr size_t kMask = kInterSize - 1;
+  static constexpr size_t kCacheLine = 64;
+  static_assert(std::has_single_bit(kInterSize), "Deque block size must be a power of two");
+
+  struct Block {
+    std::atomic<Block*> next{nullptr};
+    alignas(T) unsigned char storage[kInterSize * sizeof(T)];
+
+    T* slot(size_t pos) { return reinterpret_cast<T*>(storage) + (pos & kMask); }
+  };
+
+  using AllocTraits = std::allocator_traits<Alloc>;
+  using ElemAlloc = typename AllocTraits::template rebind_alloc<T>;
+  using ElemAllocTraits = std::allocator_traits<ElemAlloc>;
+  using BlockAlloc = typename AllocTraits::template rebind_alloc<Block>;
+  using BlockAllocTraits = std::allocator_traits<BlockAlloc>;
+
+ public:
+  explicit SpscDeque(const Alloc& alloc = Alloc()) : elem_alloc_(alloc), alloc_(alloc) {
+    Block* block = new_block();
+    producer_.block = block;
+    consumer_.block = block;
+  }
+
+  SpscDeque(const SpscDeque&) = delete;
+  SpscDeque& operator=(const SpscDeque&) = delete;
+
+  ~SpscDeque() {
+    Block* block = consumer_.block;
+    for (size_t pos = consumer_.head; pos != producer_.tail; ++pos) {
+      if (pos == consumer_.block_start + kInterSize) {
+        block = block->next.load(std::memory_order_relaxed);
+        consumer_.block_start = pos;
+      }
+      ElemAllocTraits::destroy(elem_alloc_, block->slot(pos));
+    }
+    block = consumer_.block;
+    while (block != nullptr) {
+      Block* next = block->next.load(std::memory_order_relaxed);
+      delete_block(block);
+      block = next;
+    }
+    block = free_.load(std::memory_order_acquire);
+    while (block != nullptr) {
+      Block* next = block->next.load(std::memory_order_relaxed);
+      delete_block(block);
+      block = next;
+    }
+  }
+
+  // Producer side
+
+  template <typename... Args>
+  void emplace(Args&&... args) {
+    size_t pos = producer_.tail;
+    ElemAllocTraits::construct(elem_alloc_, tail_slot(pos), std::forward<Args>(args)...);
+    producer_.tail = pos + 1;
+    tail_.store(pos + 1, std::memory_order_release);
+  }
+
+  void push(const T& value) { emplace(value); }
+
+  void push(T&& value) { emplace(std::move(value)); }
+
+  // Builds every element first and publishes them with a single store
+  template <std::input_iterator InputIt>
+  size_t push_batch(InputIt first, InputIt last) {
+    size_t pos = producer_.tail;
+    try {
+      for (; first != last; ++first, ++pos) {
+        ElemAllocTraits::construct(elem_alloc_, tail_slot(pos), *first);
+      }
+    } catch (...) {
+      // Elements built before the failure stay in the queue
+      producer_.tail = pos;
+      tail_.store(pos, std::memory_order_release);
+      throw;
+    }
+    size_t pushed = pos - producer_.tail;
+    producer_.tail = pos;
+    tail_.store(pos, std::memory_order_release);
+    return pushed;
+  }
+
+  // Consumer side
+
+  bool try_pop(T& value) { return pop_batch(&value, 1) == 1; }
+
+  // Moves up to max_count elements to out, reading tail_ and publishing
+  // head_ once per call
+  template <typename OutputIt>
+  size_t pop_batch(OutputIt out, size_t max_count) {
+    size_t pos = consumer_.head;
+    if (consumer_.tail_cache - pos < max_count) {
+      consumer_.tail_cache = tail_.load(std::memory_order_acquire);
+    }
+    size_t count = std::min(max_count, consumer_.tail_cache - pos);
+    for (size_t i = 0; i < count; ++i, ++pos) {
+      if (pos == consumer_.block_start + kInterSize) {
+        Block* next = consumer_.block->next.load(std::memory_order_acquire);
+        recycle(consumer_.block);
+        consumer_.block = next;
+        consumer_.block_start = pos;
+      }
+      T* place = consumer_.block->slot(pos);
+      *out = std::move(*place);
+      ++out;
+      ElemAllocTraits::destroy(elem_alloc_, place);
+    }
+    consumer_.head = pos;
+    head_.store(pos, std::memory_order_release);
+    return count;
+  }
+
+  // Exact only when called from one of the two threads while the other is idle
+  size_t size_approx() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
   }
 
-  void erase(const_iterator citer) { erase(citer.remove_const()); }
+  bool empty() const { return size_approx() == 0; }
 
  private:
-  void reallocate() {
-    std::vector<T*> new_out(3 * outer_.size());
-    for (size_t i = 0; i < new_out.size(); ++i) {
-      if (i < outer_.size() || i >= 2 * outer_.size()) {
-        new_out[i] = reinterpret_cast<T*>(new char[kInterSize * sizeof(T)]);
+  // Slot for position pos, linking a fresh block when pos starts a new one.
+  // The link is released before tail_ moves past it, so the consumer always
+  // finds it.
+  T* tail_slot(size_t pos) {
+    if (pos == producer_.block_start + kInterSize) {
+      Block* block = take_free_block();
+      producer_.block->next.store(block, std::memory_order_release);
+      producer_.block = block;
+      producer_.block_start = pos;
+    }
+    return producer_.block->slot(pos);
+  }
+
+  Block* new_block() {
+    Block* block = BlockAllocTraits::allocate(alloc_, 1);
+    new(block) Block();
+    return block;
+  }
+
+  void delete_block(Block* block) {
+    block->~Block();
+    BlockAllocTraits::deallocate(alloc_, block, 1);
+  }
+
+  // Free list: only the consumer pushes and only the producer pops, and a
+  // block is never pushed again before it has been popped, so the pop side
+  // is free of ABA
+  void recycle(Block* block) {
+    Block* head = free_.load(std::memory_order_relaxed);
+    do {
+      block->next.store(head, std::memory_order_relaxed);
+    } while (!free_.compare_exchange_weak(head, block, std::memory_order_release,
+                                          std::memory_order_relaxed));
+  }
+
+  Block* take_free_block() {
+    Block* head = free_.load(std::memory_order_acquire);
+    while (head != nullptr &&
+           !free_.compare_exchange_weak(head, head->next.load(std::memory_order_relaxed),
+                                        std::memory_order_acquire, std::memory_order_acquire)) {
+    }
+    if (head == nullptr) {
+      return new_block();
+    }
+    head->next.store(nullptr, std::memory_order_relaxed);
+    return head;
+  }
+
+  struct alignas(kCacheLine) Producer {
+    size_t tail = 0;
+    size_t block_start = 0;
+    Block* block = nullptr;
+  };
+
+  struct alignas(kCacheLine) Consumer {
+    size_t head = 0;
+    size_t tail_cache = 0;
+    size_t block_start = 0;
+    Block* block = nullptr;
+  };
+
+  ElemAlloc elem_alloc_;
+  BlockAlloc alloc_;
+  Producer producer_;
+  alignas(kCacheLine) std::atomic<size_t> tail_{0};
+  Consumer consumer_;
+  alignas(kCacheLine) std::atomic<size_t> head_{0};
+  alignas(kCacheLine) std::atomic<Block*> free_{nullptr};
+};
+
+// Chase-Lev work-stealing deque (Le, Pop, Cohen, Nardelli 2013 memory
+// orderings). The owner thread pushes and pops at the bottom, any thread may
+// steal from the top. Elements live in Deque-style blocks indexed through a
+// power-of-two block map used as a ring; growing doubles the map and moves
+// block pointers rather than elements. Old maps and blocks are kept until
+// destruction because a thief may still be reading through them.
+template <typename T, size_t BlockSize = 0>
+class WorkStealingDeque {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "WorkStealingDeque elements are read and written atomically");
+  static constexpr int64_t kInterSize = DequeBlockSize<T, BlockSize>();
+  static constexpr int64_t kShift = std::countr_zero(static_cast<uint64_t>(kInterSize));
+  static constexpr int64_t kMask = kInterSize - 1;
+  static_assert(std::has_single_bit(static_cast<uint64_t>(kInterSize)),
+                "Deque block size must be a power of two");
+
+  struct Map {
+    int64_t mask;
+    std::vector<std::atomic<T>*> blocks;
+
+    explicit Map(size_t size) : mask(size - 1), blocks(size, nullptr) {}
+
+    int64_t capacity() const { return (mask + 1) << kShift; }
+
+    std::atomic<T>& at(int64_t pos) { return blocks[(pos >> kShift) & mask][pos & kMask]; }
+  };
+
+ public:
+  WorkStealingDeque() {
+    Map* map = new Map(2);
+    for (auto& block : map->blocks) {
+      block = new std::atomic<T>[kInterSize];
+    }
+    map_.store(map, std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  ~WorkStealingDeque() {
+    Map* map = map_.load(std::memory_order_relaxed);
+    for (std::atomic<T>* block : map->blocks) {
+      delete[] block;
+    }
+    delete map;
+    for (Map* old : retired_maps_) {
+      delete old;
+    }
+    for (std::atomic<T>* block : retired_blocks_) {
+      delete[] block;
+    }
+  }
+
+  // Owner only
+  void push(T value) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    Map* map = map_.load(std::memory_order_relaxed);
+    if (bottom - top > map->capacity() - 1) {
+      map = grow(map, top, bottom);
+    }
+    map->at(bottom).store(value, std::memory_order_relaxed);
+    // A release store rather than the paper's release fence: same cost, and
+    // thread sanitizers understand it
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  // Owner only; takes the most recently pushed element
+  std::optional<T> pop() {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Map* map = map_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+    T value = map->at(bottom).load(std::memory_order_relaxed);
+    if (top == bottom) {
+      // Last element: race the thieves for it
+      bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed);
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      if (!won) {
+        return std::nullopt;
+      }
+    }
+    return value;
+  }
+
+  // Any thread; takes the oldest element. Returns nothing when the deque is
+  // empty or another thread won the race for the same element.
+  std::optional<T> steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return std::nullopt;
+    }
+    Map* map = map_.load(std::memory_order_acquire);
+    T value = map->at(top).load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return std::nullopt;
+    }
+    return value;
+  }
+
+  size_t size_approx() const {
+    int64_t size = bottom_.load(std::memory_order_relaxed) - top_.load(std::memory_order_relaxed);
+    return size > 0 ? size : 0;
+  }
+
+  bool empty() const { return size_approx() == 0; }
+
+ private:
+  // Called by the owner when the ring is full. Each live block keeps its
+  // physical block, just under its slot in the twice larger map. The one
+  // exception is a block shared by the oldest and newest elements (the ring
+  // wrapped inside it): both halves are copied out and the shared block is
+  // retired untouched, so thieves still reading the old map see valid data.
+  Map* grow(Map* map, int64_t top, int64_t bottom) {
+    Map* next = new Map(2 * map->blocks.size());
+    std::vector<bool> claimed(map->blocks.size(), false);
+    int64_t first = top >> kShift;
+    int64_t last = (bottom - 1) >> kShift;
+    bool wrapped = (last - first) == static_cast<int64_t>(map->blocks.size());
+    for (int64_t index = first; index <= last; ++index) {
+      size_t old_slot = index & map->mask;
+      if (wrapped && (index == first || index == last)) {
+        std::atomic<T>* block = new std::atomic<T>[kInterSize];
+        int64_t from = std::max(top, index << kShift);
+        int64_t to = std::min(bottom, (index + 1) << kShift);
+        for (int64_t pos = from; pos < to; ++pos) {
+          block[pos & kMask].store(map->at(pos).load(std::memory_order_relaxed),
+                                   std::memory_order_relaxed);
+        }
+        if (index == first) {
+          retired_blocks_.push_back(map->blocks[old_slot]);
+        }
+        next->blocks[index & next->mask] = block;
       } else {
-        new_out[i] = outer_[i - outer_.size()];
+        next->blocks[index & next->mask] = map->blocks[old_slot];
+      }
+      claimed[old_slot] = true;
+    }
+    size_t spare = 0;
+    for (auto& block : next->blocks) {
+      if (block != nullptr) {
+        continue;
       }
+      while (spare < claimed.size() && claimed[spare]) {
+        ++spare;
+      }
+      block = (spare < claimed.size() ? map->blocks[spare++] : new std::atomic<T>[kInterSize]);
     }
-    start_ += kInterSize * outer_.size();
-    outer_ = new_out;
+    retired_maps_.push_back(map);
+    map_.store(next, std::memory_order_release);
+    return next;
   }
 
-  size_t start_;
-  size_t size_;
-  std::vector<T*> outer_;
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Map*> map_{nullptr};
+  std::vector<Map*> retired_maps_;
+  std::vector<std::atomic<T>*> retired_blocks_;
 };
+
+// Fixed-size thread pool on top of WorkStealingDeque. Each worker runs its
+// own tasks newest first and steals the oldest tasks of a random victim when
+// it runs dry. Tasks submitted from outside the pool go through a shared
+// mutex-protected Deque.
+class WorkStealingPool {
+ public:
+  explicit WorkStealingPool(size_t threads = std::thread::hardware_concurrency());
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+  ~WorkStealingPool();
+
+  void submit(std::function<void()> task);
+  // Blocks until every submitted task, including those spawned by tasks,
+  // has finished. Must not be called from a task.
+  void wait();
+  size_t size() const { return workers_.size(); }
+
+ private:
+  using Task = std::function<void()>;
+
+  struct Worker {
+    WorkStealingDeque<Task*> tasks;
+    std::thread thread;
+  };
+
+  void run(size_t index);
+  Task* find_task(size_t index, std::mt19937& gen);
+  void finish(Task* task);
+
+  static thread_local WorkStealingPool* current_pool_;
+  static thread_local size_t current_index_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  Deque<Task*> injected_;
+  std::atomic<size_t> pending_{0};
+  // Tasks sitting in some deque or in injected_, not yet picked up
+  std::atomic<size_t> queued_{0};
+  std::atomic<size_t> sleeping_{0};
+  bool stop_ = false;
+};
+
+inline thread_local WorkStealingPool* WorkStealingPool::current_pool_ = nullptr;
+inline thread_local size_t WorkStealingPool::current_index_ = 0;
+
+inline WorkStealingPool::WorkStealingPool(size_t threads) {
+  threads = std::max<size_t>(threads, 1);
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    workers_[i]->thread = std::thread([this, i] { run(i); });
+  }
+}
+
+inline WorkStealingPool::~WorkStealingPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+inline void WorkStealingPool::submit(std::function<void()> task) {
+  Task* item = new Task(std::move(task));
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  if (current_pool_ == this) {
+    // Counted before the push so a thief never takes queued_ below zero.
+    // Pairs with the sleeper bumping sleeping_ before it checks queued_:
+    // either it sees this task or we see it and wake it under the mutex
+    queued_.fetch_add(1, std::memory_order_seq_cst);
+    workers_[current_index_]->tasks.push(item);
+    if (sleeping_.load(std::memory_order_seq_cst) == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_.notify_one();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    injected_.push_back(item);
+    queued_.fetch_add(1, std::memory_order_seq_cst);
+  }
+  wake_.notify_one();
+}
+
+inline void WorkStealingPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return pending_.load(std::memory_order_acquire) == 0; });
+}
+
+inline WorkStealingPool::Task* WorkStealingPool::find_task(size_t index, std::mt19937& gen) {
+  if (std::optional<Task*> task = workers_[index]->tasks.pop()) {
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    return *task;
+  }
+  // Visit every victim once, starting from a random one
+  std::uniform_int_distribution<size_t> victim(0, workers_.size() - 1);
+  size_t start = victim(gen);
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    size_t other = (start + i) % workers_.size();
+    if (other == index) {
+      continue;
+    }
+    if (std::optional<Task*> task = workers_[other]->tasks.steal()) {
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      return *task;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (injected_.size() == 0) {
+    return nullptr;
+  }
+  Task* task = injected_.front();
+  injected_.pop_front();
+  queued_.fetch_sub(1, std::memory_order_relaxed);
+  return task;
+}
+
+inline void WorkStealingPool::finish(Task* task) {
+  delete task;
+  if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.notify_all();
+  }
+}
+
+inline void WorkStealingPool::run(size_t index) {
+  current_pool_ = this;
+  current_index_ = index;
+  std::mt19937 gen(static_cast<unsigned>(index) * 7919 + 1);
+  while (true) {
+    if (Task* task = find_task(index, gen)) {
+      (*task)();
+      finish(task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    sleeping_.fetch_add(1, std::memory_order_seq_cst);
+    wake_.wait(lock, [this] { return stop_ || queued_.load(std::memory_order_seq_cst) != 0; });
+    sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    if (stop_) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,580 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "deque.h"
+#include "stackallocator.h"
+
+// Usage: deque_benchmark [--max-count=N] [--max-bytes=N] [--min-time=SECONDS]
+//                        [--threads=N] [--tasks=N] [--depth=N]
+//                        [--filter=SUBSTRING] [--json]
+// Runs the same operations on Deque, std::deque, std::vector and List for
+// element sizes from 1 to 256 bytes and counts from 10^3 up to --max-count
+// (use --max-count=100000000 for the full sweep; sizes whose data would
+// exceed --max-bytes are skipped). Every row reports throughput, the peak
+// RSS of the run and the number of heap allocations made by the timed part
+// of one run, leaving out untimed setup. The pool_* rows compare WorkStealingPool against a pool sharing one mutex-protected
+// Deque. Inputs come from a fixed seed, so JSON output can be diffed.
+
+namespace Bench {
+  std::atomic<size_t> allocations{0};
+}
+
+// Counts every allocation of the process; all containers measured here go
+// through std::allocator and end up in this operator new
+void* operator new(size_t size) {
+  Bench::allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+// Kept out of line so GCC does not pair the inlined free() with new
+__attribute__((noinline)) void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+namespace Bench {
+  const uint64_t kSeed = 20240601;
+
+  struct Options {
+    size_t max_count = 1000000;
+    size_t max_bytes = size_t(1) << 30;
+    double min_time = 0.2;
+    size_t threads = std::thread::hardware_concurrency();
+    size_t tasks = 1000000;
+    size_t depth = 20;
+    std::string filter;
+    bool json = false;
+  };
+
+  struct Result {
+    std::string name;
+    std::string container;
+    size_t element_size;
+    size_t count;
+    double ops_per_sec;
+    long peak_rss_kb;
+    size_t allocations;
+  };
+
+  template <typename T>
+  void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  // Element of N bytes ordered by its leading bytes
+  template <size_t N>
+  struct Payload {
+    unsigned char bytes[N];
+
+    Payload() : Payload(0) {}
+
+    explicit Payload(uint64_t key) {
+      std::memset(bytes, 0, N);
+      for (size_t i = 0; i < std::min<size_t>(N, 8); ++i) {
+        bytes[i] = static_cast<unsigned char>(key >> (8 * (std::min<size_t>(N, 8) - 1 - i)));
+      }
+    }
+
+    bool operator<(const Payload& other) const {
+      return std::memcmp(bytes, other.bytes, std::min<size_t>(N, 8)) < 0;
+    }
+  };
+
+  uint64_t NextRandom(uint64_t& state) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state >> 17;
+  }
+
+  // VmHWM is the peak RSS since the last reset through clear_refs; without
+  // procfs this falls back to the peak of the whole process
+  void ResetPeakRss() { std::ofstream("/proc/self/clear_refs") << "5"; }
+
+  long PeakRssKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+      if (line.rfind("VmHWM:", 0) == 0) {
+        return std::stol(line.substr(6));
+      }
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+  }
+
+  // Deque and List only name their element type on the iterator
+  template <typename Container>
+  using ValueOf = typename Container::iterator::value_type;
+
+  template <typename Container>
+  void Fill(Container& container, size_t count, uint64_t seed) {
+    uint64_t state = seed;
+    for (size_t i = 0; i < count; ++i) {
+      container.push_back(ValueOf<Container>(NextRandom(state)));
+    }
+  }
+
+  // Each operation builds what it needs untimed and returns the seconds
+  // and heap allocations spent on its ops timed operations
+  using Clock = std::chrono::steady_clock;
+
+  struct Timing {
+    double seconds;
+    size_t allocations;
+  };
+
+  class Timer {
+   public:
+    Timer() : allocations_(allocations.load(std::memory_order_relaxed)), start_(Clock::now()) {}
+
+    Timing Stop() const {
+      std::chrono::duration<double> elapsed = Clock::now() - start_;
+      return {elapsed.count(), allocations.load(std::memory_order_relaxed) - allocations_};
+    }
+
+   private:
+    size_t allocations_;
+    Clock::time_point start_;
+  };
+
+  template <typename Container>
+  Timing PushBack(size_t count) {
+    Container container;
+    Timer timer;
+    for (size_t i = 0; i < count; ++i) {
+      container.push_back(ValueOf<Container>(i));
+    }
+    Timing timing = timer.Stop();
+    DoNotOptimize(container.size());
+    return timing;
+  }
+
+  template <typename Container>
+  Timing PushFront(size_t count) {
+    Container container;
+    Timer timer;
+    for (size_t i = 0; i < count; ++i) {
+      container.push_front(ValueOf<Container>(i));
+    }
+    Timing timing = timer.Stop();
+    DoNotOptimize(container.size());
+    return timing;
+  }
+
+  template <typename Container>
+  Timing PopBack(size_t count) {
+    Container container;
+    Fill(container, count, kSeed);
+    Timer timer;
+    for (size_t i = 0; i < count; ++i) {
+      container.pop_back();
+    }
+    Timing timing = timer.Stop();
+    DoNotOptimize(container.size());
+    return timing;
+  }
+
+  template <typename Container>
+  Timing PopFront(size_t count) {
+    Container container;
+    Fill(container, count, kSeed);
+    Timer timer;
+    for (size_t i = 0; i < count; ++i) {
+      container.pop_front();
+    }
+    Timing timing = timer.Stop();
+    DoNotOptimize(container.size());
+    return timing;
+  }
+
+  // Queue of a thousand elements; every op pushes at the back and pops at
+  // the front
+  template <typename Container>
+  Timing Fifo(size_t count) {
+    Container container;
+    Fill(container, 1000, kSeed);
+    Timer timer;
+    for (size_t i = 0; i < count; ++i) {
+      container.push_back(ValueOf<Container>(i));
+      container.pop_front();
+    }
+    Timing timing = timer.Stop();
+    DoNotOptimize(container.size());
+    return timing;
+  }
+
+  template <typename Container>
+  Timing RandomAccess(size_t count) {
+    Container container;
+    Fill(container, count, kSeed);
+    uint64_t state = kSeed;
+    unsigned sum = 0;
+    Timer timer;
+    for (size_t i = 0; i < count; ++i) {
+      sum += container[NextRandom(state) % count].bytes[0];
+    }
+    Timing timing = timer.Stop();
+    DoNotOptimize(sum);
+    return timing;
+  }
+
+  template <typename Container>
+  Timing Iterate(size_t count) {
+    Container container;
+    Fill(container, count, kSeed);
+    unsigned sum = 0;
+    Timer timer;
+    for (auto& value : container) {
+      sum += value.bytes[0];
+    }
+    Timing timing = timer.Stop();
+    DoNotOptimize(sum);
+    return timing;
+  }
+
+  template <typename Container>
+  Timing Sort(size_t count) {
+    Container container;
+    Fill(container, count, kSeed);
+    Timer timer;
+    std::sort(container.begin(), container.end());
+    Timing timing = timer.Stop();
+    DoNotOptimize(container.size());
+    return timing;
+  }
+
+  // Middle inserts are linear for the array-based containers, so only a
+  // few are timed on large inputs
+  size_t MiddleInserts(size_t count) {
+    return std::clamp<size_t>((size_t(1) << 24) / count, 1, count);
+  }
+
+  template <typename Container>
+  Timing MiddleInsert(size_t count) {
+    Container container;
+    Fill(container, count, kSeed);
+    size_t inserts = MiddleInserts(count);
+    Timer timer;
+    if constexpr (requires { container[0]; }) {
+      for (size_t i = 0; i < inserts; ++i) {
+        container.insert(container.begin() + container.size() / 2,
+                         ValueOf<Container>(i));
+      }
+    } else {
+      auto middle = container.cbegin();
+      for (size_t i = 0; i < count / 2; ++i) {
+        ++middle;
+      }
+      for (size_t i = 0; i < inserts; ++i) {
+        container.insert(middle, ValueOf<Container>(i));
+      }
+    }
+    Timing timing = timer.Stop();
+    DoNotOptimize(container.size());
+    return timing;
+  }
+
+  // Repeats body until min_time is spent; RSS and allocations are taken
+  // from the first run
+  Result Measure(const Options& options, const std::string& name, const std::string& container,
+                 size_t element_size, size_t count, size_t ops, Timing (*body)(size_t)) {
+    ResetPeakRss();
+    Timing first = body(count);
+    long peak_rss_kb = PeakRssKb();
+    double seconds = first.seconds;
+    size_t runs = 1;
+    while (seconds < options.min_time && runs < 1000) {
+      seconds += body(count).seconds;
+      ++runs;
+    }
+    return {name, container, element_size, count, ops * runs / std::max(seconds, 1e-9),
+            peak_rss_kb, first.allocations};
+  }
+
+  class Runner {
+   public:
+    explicit Runner(const Options& options) : options_(options) {}
+
+    const std::vector<Result>& results() const { return results_; }
+
+    void Run(const std::string& name, const std::string& container, size_t element_size,
+             size_t count, size_t ops, Timing (*body)(size_t)) {
+      if (!options_.filter.empty() &&
+          (name + "/" + container).find(options_.filter) == std::string::npos) {
+        return;
+      }
+      results_.push_back(Measure(options_, name, container, element_size, count, ops, body));
+      if (!options_.json) {
+        Print(results_.back());
+      }
+    }
+
+    void Add(const Result& result) {
+      if (!options_.filter.empty() &&
+          (result.name + "/" + result.container).find(options_.filter) == std::string::npos) {
+        return;
+      }
+      results_.push_back(result);
+      if (!options_.json) {
+        Print(result);
+      }
+    }
+
+    static void PrintHeader() {
+      std::cout << std::left << std::setw(16) << "benchmark" << std::setw(18) << "container"
+                << std::right << std::setw(6) << "bytes" << std::setw(12) << "count"
+                << std::setw(14) << "Mops/s" << std::setw(14) << "peak RSS MB" << std::setw(12)
+                << "allocs" << '\n';
+    }
+
+   private:
+    static void Print(const Result& result) {
+      std::cout << std::left << std::setw(16) << result.name << std::setw(18) << result.container
+                << std::right << std::setw(6) << result.element_size << std::setw(12)
+                << result.count << std::setw(14) << std::fixed << std::setprecision(2)
+                << result.ops_per_sec / 1e6 << std::setw(14) << std::setprecision(1)
+                << result.peak_rss_kb / 1024.0 << std::setw(12) << result.allocations << '\n';
+    }
+
+    const Options& options_;
+    std::vector<Result> results_;
+  };
+
+  template <typename Container>
+  void RunContainer(Runner& runner, const std::string& container, size_t element_size,
+                    size_t count) {
+    runner.Run("push_back", container, element_size, count, count, PushBack<Container>);
+    if constexpr (requires(Container c) { c.push_front(c.back()); }) {
+      runner.Run("push_front", container, element_size, count, count, PushFront<Container>);
+    }
+    runner.Run("pop_back", container, element_size, count, count, PopBack<Container>);
+    if constexpr (requires(Container c) { c.pop_front(); }) {
+      runner.Run("pop_front", container, element_size, count, count, PopFront<Container>);
+      runner.Run("fifo", container, element_size, count, count, Fifo<Container>);
+    }
+    if constexpr (requires(Container c) { c[0]; }) {
+      runner.Run("random_access", container, element_size, count, count,
+                 RandomAccess<Container>);
+    }
+    runner.Run("iterate", container, element_size, count, count, Iterate<Container>);
+    if constexpr (std::random_access_iterator<typename Container::iterator>) {
+      runner.Run("sort", container, element_size, count, count, Sort<Container>);
+    }
+    runner.Run("middle_insert", container, element_size, count, MiddleInserts(count),
+               MiddleInsert<Container>);
+  }
+
+  template <size_t N>
+  void RunElementSize(Runner& runner, const Options& options) {
+    for (size_t count = 1000; count <= options.max_count; count *= 10) {
+      if (count * N > options.max_bytes) {
+        break;
+      }
+      RunContainer<Deque<Payload<N>>>(runner, "Deque", N, count);
+      RunContainer<std::deque<Payload<N>>>(runner, "std::deque", N, count);
+      RunContainer<std::vector<Payload<N>>>(runner, "std::vector", N, count);
+      RunContainer<List<Payload<N>>>(runner, "List", N, count);
+    }
+  }
+
+  // Baseline: every worker pushes and pops the same locked Deque
+  class MutexPool {
+   public:
+    explicit MutexPool(size_t threads) {
+      for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { Run(); });
+      }
+    }
+
+    ~MutexPool() {
+      wait();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_all();
+      for (auto& worker : workers_) {
+        worker.join();
+      }
+    }
+
+    void submit(std::function<void()> task) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++pending_;
+        tasks_.push_back(std::move(task));
+      }
+      wake_.notify_one();
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      idle_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+   private:
+    void Run() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        wake_.wait(lock, [this] { return stop_ || tasks_.size() != 0; });
+        if (tasks_.size() == 0) {
+          return;
+        }
+        std::function<void()> task = std::move(tasks_.back());
+        tasks_.pop_back();
+        lock.unlock();
+        task();
+        lock.lock();
+        if (--pending_ == 0) {
+          idle_.notify_all();
+        }
+      }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    Deque<std::function<void()>> tasks_;
+    size_t pending_ = 0;
+    bool stop_ = false;
+  };
+
+  template <typename Pool>
+  void Spawn(Pool& pool, std::atomic<size_t>& leaves, size_t depth) {
+    if (depth == 0) {
+      leaves.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    pool.submit([&pool, &leaves, depth] { Spawn(pool, leaves, depth - 1); });
+    pool.submit([&pool, &leaves, depth] { Spawn(pool, leaves, depth - 1); });
+  }
+
+  // Many tiny tasks submitted from outside the pool
+  template <typename Pool>
+  Timing FlatTasks(const Options& options) {
+    std::atomic<size_t> done{0};
+    Pool pool(options.threads);
+    Timer timer;
+    for (size_t i = 0; i < options.tasks; ++i) {
+      pool.submit([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+    }
+    pool.wait();
+    Timing timing = timer.Stop();
+    if (done.load() != options.tasks) {
+      std::cerr << "flat: lost tasks" << std::endl;
+    }
+    return timing;
+  }
+
+  // Binary fork tree: every task spawns its children from inside the pool
+  template <typename Pool>
+  Timing ForkTree(const Options& options) {
+    std::atomic<size_t> leaves{0};
+    Pool pool(options.threads);
+    Timer timer;
+    pool.submit([&pool, &leaves, &options] { Spawn(pool, leaves, options.depth); });
+    pool.wait();
+    Timing timing = timer.Stop();
+    if (leaves.load() != (size_t(1) << options.depth)) {
+      std::cerr << "fork: lost tasks" << std::endl;
+    }
+    return timing;
+  }
+
+  void RunPool(Runner& runner, const Options& options, const std::string& name,
+               const std::string& container, size_t tasks, Timing (*body)(const Options&)) {
+    if (!options.filter.empty() &&
+        (name + "/" + container).find(options.filter) == std::string::npos) {
+      return;
+    }
+    ResetPeakRss();
+    Timing timing = body(options);
+    runner.Add({name, container, sizeof(std::function<void()>), tasks, tasks / timing.seconds,
+                PeakRssKb(), timing.allocations});
+  }
+
+  std::vector<Result> RunAll(const Options& options) {
+    Runner runner(options);
+    RunElementSize<1>(runner, options);
+    RunElementSize<8>(runner, options);
+    RunElementSize<32>(runner, options);
+    RunElementSize<256>(runner, options);
+
+    size_t tree_tasks = (size_t(2) << options.depth) - 1;
+    RunPool(runner, options, "pool_flat", "WorkStealingPool", options.tasks,
+            FlatTasks<WorkStealingPool>);
+    RunPool(runner, options, "pool_flat", "MutexPool", options.tasks, FlatTasks<MutexPool>);
+    RunPool(runner, options, "pool_fork", "WorkStealingPool", tree_tasks,
+            ForkTree<WorkStealingPool>);
+    RunPool(runner, options, "pool_fork", "MutexPool", tree_tasks, ForkTree<MutexPool>);
+    return runner.results();
+  }
+
+  void PrintJson(const std::vector<Result>& results) {
+    std::cout << "{\n  \"seed\": " << kSeed << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+      std::cout << "    {\"name\": \"" << results[i].name << "\", \"container\": \""
+                << results[i].container << "\", \"element_size\": " << results[i].element_size
+                << ", \"count\": " << results[i].count << ", \"ops_per_sec\": " << std::fixed
+                << std::setprecision(0) << results[i].ops_per_sec
+                << ", \"peak_rss_kb\": " << results[i].peak_rss_kb
+                << ", \"allocations\": " << results[i].allocations << "}"
+                << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    std::cout << "  ]\n}\n";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  Bench::Options options;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--max-count=", 12) == 0) {
+      options.max_count = std::stoull(argv[i] + 12);
+    } else if (strncmp(argv[i], "--max-bytes=", 12) == 0) {
+      options.max_bytes = std::stoull(argv[i] + 12);
+    } else if (strncmp(argv[i], "--min-time=", 11) == 0) {
+      options.min_time = std::stod(argv[i] + 11);
+    } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+      options.threads = std::stoull(argv[i] + 10);
+    } else if (strncmp(argv[i], "--tasks=", 8) == 0) {
+      options.tasks = std::stoull(argv[i] + 8);
+    } else if (strncmp(argv[i], "--depth=", 8) == 0) {
+      options.depth = std::stoull(argv[i] + 8);
+    } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+      options.filter = argv[i] + 9;
+    } else if (strcmp(argv[i], "--json") == 0) {
+      options.json = true;
+    } else {
+      std::cerr << "unknown option " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+  options.threads = std::max<size_t>(options.threads, 1);
+
+  if (!options.json) {
+    Bench::Runner::PrintHeader();
+  }
+  std::vector<Bench::Result> results = Bench::RunAll(options);
+  if (options.json) {
+    Bench::PrintJson(results);
+  }
+}
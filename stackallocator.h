@@ -55,6 +55,11 @@ class StackAllocator {
 
   StackStorage<N>* get_storage() const { return storage_; }
 
+  template <typename U>
+  bool operator==(const StackAllocator<U, N>& other) const {
+    return storage_ == other.get_storage();
+  }
+
   template <typename U>
   struct rebind {
     using other = StackAllocator<U, N>;
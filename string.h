@@ -1,29 +1,102 @@
+#include <algorithm>
+#include <cstdint>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
-class String {
+class String;
+
+// Non-owning view of a char range; valid while the viewed buffer is. Lets
+// parsing code slice and compare without allocating.
+class StringView {
  private:
+  // Below this many bytes a memchr scan for the first byte beats filling a
+  // Horspool table on typical text (break-even measured near 128 KiB)
+  static constexpr size_t kShortText = size_t(1) << 17;
+
+  const char* data_;
   size_t size_;
-  size_t capacity_;
-  char* string_;
 
-  // Help-method
+ public:
+  // Constructors
+  StringView();
+  StringView(const char* cstyle);
+  StringView(const char* data, size_t size);
+  StringView(const String& string);
+
+  // Operators
+  const char& operator[](size_t index) const;
+
+  // Methods
+  size_t length() const;
+  size_t size() const;
+  bool empty() const;
+  const char* data() const;
+  const char& front() const;
+  const char& back() const;
+  StringView substr(size_t start, size_t count) const;
+  // Same conventions as String: length() when nothing is found, an empty
+  // substring is never found
+  size_t find(char sym, size_t pos = 0) const;
+  size_t find(StringView substring, size_t pos = 0) const;
+  size_t rfind(StringView substring) const;
+  int compare(StringView other) const;
+};
+
+class String {
+ private:
+  // Short strings (up to 23 chars) live in local_ and never touch the heap;
+  // long ones reuse the same bytes for the heap pointer and capacity
+  static constexpr size_t kLocalCapacity = 24;
+
+  struct Heap {
+    char* data;
+    size_t capacity;  // includes NUL
+  };
+
+  size_t size_ : 63;  // includes NUL
+  size_t on_heap_ : 1;
+  union {
+    Heap heap_;
+    char local_[kLocalCapacity];
+  };
+
+  // Help-methods
   void swap(String& other);
+  bool is_local() const;
+  size_t allocated() const;
+  void reallocate(size_t new_capacity);
   // Allocation constructor
   String(size_t size);
 
+  // Tokenizer helpers
+  struct StreamBufferAccess;
+  static bool is_space(char sym);
+  static const char* find_space(const char* first, const char* last);
+
+  friend std::istream& operator>>(std::istream& input, String& string);
+  friend std::vector<StringView> readTokens(StringView text);
+
  public:
   // Constructors
   String();
   String(const String& other);
+  String(String&& other) noexcept;
   String(const char* cstyle);
   String(size_t len, char sym);
   String(char sym);
+  explicit String(StringView view);
 
   // Operators
   String& operator=(const String& other);
+  String& operator=(String&& other) noexcept;
   String& operator+=(char sym);
-  String& operator+=(const String& other);
+  String& operator+=(StringView other);
   char& operator[](size_t index);
   const char& operator[](size_t index) const;
 
@@ -31,15 +104,21 @@ class String {
   size_t length() const;
   size_t size() const;
   size_t capacity() const;
+  void reserve(size_t count);
   void push_back(char sym);
   void pop_back();
   char& front();
   char& back();
   const char& front() const;
   const char& back() const;
-  size_t find(const String& substring) const;
-  size_t rfind(const String& substring) const;
+  // Searches return length() when nothing is found; an empty substring
+  // is never found
+  size_t find(char sym, size_t pos = 0) const;
+  size_t find(StringView substring, size_t pos = 0) const;
+  size_t rfind(StringView substring) const;
   String substr(size_t start, size_t count) const;
+  // Zero-copy substr; invalidated by any change to the String
+  StringView view(size_t start, size_t count) const;
   bool empty() const;
   void clear();
   void shrink_to_fit();
@@ -50,36 +129,202 @@ class String {
   ~String();
 };
 
+// Precompiled substring search for one pattern over many texts.
+// Patterns shorter than kShortPattern are found with memchr on their
+// first byte and memcmp; longer ones with Boyer-Moore-Horspool, whose
+// bad-character tables for both directions are built once here.
+class Searcher {
+ public:
+  static constexpr size_t kShortPattern = 8;
+
+ private:
+  friend class StringView;
+
+  String pattern_;
+  size_t shift_[256];
+  size_t rshift_[256];
+
+  // Building blocks shared with one-off StringView searches. All of them
+  // expect a non-empty pattern no longer than [first, last)
+  static const char* scan(StringView pattern, const char* first, const char* last);
+  static const char* rscan(StringView pattern, const char* first, const char* last);
+  static void fill_shift(StringView pattern, size_t* shift);
+  static void fill_rshift(StringView pattern, size_t* rshift);
+  static const char* horspool(StringView pattern, const size_t* shift, const char* first,
+                              const char* last);
+  static const char* rhorspool(StringView pattern, const size_t* rshift, const char* first,
+                               const char* last);
+
+ public:
+  explicit Searcher(StringView pattern);
+
+  // Start of the first (last) occurrence in [first, last), or last
+  const char* search(const char* first, const char* last) const;
+  const char* rsearch(const char* first, const char* last) const;
+
+  size_t find(StringView text, size_t pos = 0) const;
+  size_t rfind(StringView text) const;
+};
+
+StringView::StringView() : data_(""), size_(0) {}
+
+StringView::StringView(const char* cstyle) : data_(cstyle), size_(strlen(cstyle)) {}
+
+StringView::StringView(const char* data, size_t size) : data_(data), size_(size) {}
+
+StringView::StringView(const String& string) : data_(string.data()), size_(string.length()) {}
+
+const char& StringView::operator[](size_t index) const { return data_[index]; }
+
+size_t StringView::length() const { return size_; }
+
+size_t StringView::size() const { return size_; }
+
+bool StringView::empty() const { return size_ == 0; }
+
+const char* StringView::data() const { return data_; }
+
+const char& StringView::front() const { return data_[0]; }
+
+const char& StringView::back() const { return data_[size_ - 1]; }
+
+StringView StringView::substr(size_t start, size_t count) const {
+  return StringView(data_ + start, count);
+}
+
+size_t StringView::find(char sym, size_t pos) const {
+  if (pos >= size_) {
+    return size_;
+  }
+  const void* found = memchr(data_ + pos, sym, size_ - pos);
+  return found == nullptr ? size_ : static_cast<const char*>(found) - data_;
+}
+
+// One-off searches scan for the first byte; only texts long enough to pay
+// for it get a Horspool table, built on the stack for the one direction
+size_t StringView::find(StringView substring, size_t pos) const {
+  if (substring.empty() || pos >= size_ || substring.size_ > size_ - pos) {
+    return size_;
+  }
+  if (substring.size_ == 1) {
+    return find(substring[0], pos);
+  }
+  const char* last = data_ + size_;
+  if (substring.size_ < Searcher::kShortPattern || size_ - pos < kShortText) {
+    return Searcher::scan(substring, data_ + pos, last) - data_;
+  }
+  size_t shift[256];
+  Searcher::fill_shift(substring, shift);
+  return Searcher::horspool(substring, shift, data_ + pos, last) - data_;
+}
+
+size_t StringView::rfind(StringView substring) const {
+  if (substring.empty() || substring.size_ > size_) {
+    return size_;
+  }
+  const char* last = data_ + size_;
+  if (substring.size_ < Searcher::kShortPattern || size_ < kShortText) {
+    return Searcher::rscan(substring, data_, last) - data_;
+  }
+  size_t rshift[256];
+  Searcher::fill_rshift(substring, rshift);
+  return Searcher::rhorspool(substring, rshift, data_, last) - data_;
+}
+
+int StringView::compare(StringView other) const {
+  int result = memcmp(data_, other.data_, size_ < other.size_ ? size_ : other.size_);
+  if (result != 0) {
+    return result;
+  }
+  return size_ == other.size_ ? 0 : (size_ < other.size_ ? -1 : 1);
+}
 
 void String::swap(String& other) {
-  std::swap(string_, other.string_);
-  std::swap(size_, other.size_);
-  std::swap(capacity_, other.capacity_);
+  // Neither representation points into the object, so bytes can be swapped
+  size_t size = size_;
+  size_t on_heap = on_heap_;
+  size_ = other.size_;
+  on_heap_ = other.on_heap_;
+  other.size_ = size;
+  other.on_heap_ = on_heap;
+  char buffer[kLocalCapacity];
+  memcpy(buffer, local_, kLocalCapacity);
+  memcpy(local_, other.local_, kLocalCapacity);
+  memcpy(other.local_, buffer, kLocalCapacity);
 }
 
-String::String(size_t size) : size_(size + 1), capacity_(size_), string_(new char[size_]) {}
+bool String::is_local() const { return on_heap_ == 0; }
+
+// Bytes in the current buffer, NUL included
+size_t String::allocated() const { return is_local() ? kLocalCapacity : heap_.capacity; }
+
+// Moves the contents into a buffer of new_capacity bytes (NUL included),
+// falling back to local_ when it is big enough
+void String::reallocate(size_t new_capacity) {
+  if (new_capacity < kLocalCapacity) {
+    new_capacity = kLocalCapacity;
+  }
+  if (new_capacity == allocated()) {
+    return;
+  }
+  if (new_capacity == kLocalCapacity) {
+    char* old = heap_.data;
+    memcpy(local_, old, size_);
+    delete[] old;
+    on_heap_ = 0;
+    return;
+  }
+  char* buffer = new char[new_capacity];
+  memcpy(buffer, data(), size_);
+  if (!is_local()) {
+    delete[] heap_.data;
+  }
+  heap_.data = buffer;
+  heap_.capacity = new_capacity;
+  on_heap_ = 1;
+}
+
+String::String(size_t size) : size_(size + 1), on_heap_(size + 1 > kLocalCapacity) {
+  if (!is_local()) {
+    heap_.data = new char[size + 1];
+    heap_.capacity = size + 1;
+  }
+}
 
 String::String(const char* cstyle) : String(strlen(cstyle)) {
-  memcpy(string_, cstyle, size_);
+  memcpy(data(), cstyle, size_);
 }
 
 String::String(size_t len, char sym) : String(len) {
-  memset(string_, sym, len);
-  string_[len] = '\0';
+  memset(data(), sym, len);
+  data()[len] = '\0';
 }
 
-String::String() : size_(1), capacity_(2), string_(new char[2]) { string_[0] = '\0'; }
+String::String() : String(static_cast<size_t>(0)) { local_[0] = '\0'; }
+
+String::String(const String& other) : String(other.length()) {
+  memcpy(data(), other.data(), size_);
+}
 
-String::String(const String& other) : size_(other.size_), capacity_(other.capacity_),
-                                                          string_(new char[capacity_]) {
-  memcpy(string_, other.string_, size_);
+// Heap buffers are taken over, short strings are copied out of local_;
+// other is left empty
+String::String(String&& other) noexcept : size_(other.size_), on_heap_(other.on_heap_) {
+  memcpy(local_, other.local_, kLocalCapacity);
+  other.size_ = 1;
+  other.on_heap_ = 0;
+  other.local_[0] = '\0';
 }
 
 String::String(char sym) : String(1, sym) {}
 
+String::String(StringView view) : String(view.length()) {
+  memcpy(data(), view.data(), view.length());
+  data()[view.length()] = '\0';
+}
+
 String& String::operator=(const String& other) {
-  if (capacity_ >= other.size_) {
-    memcpy(string_, other.string_, other.size_);
+  if (allocated() >= other.size_) {
+    memcpy(data(), other.data(), other.size_);
     size_ = other.size_;
     return *this;
   }
@@ -88,153 +333,255 @@ String& String::operator=(const String& other) {
   return *this;
 }
 
+String& String::operator=(String&& other) noexcept {
+  if (this != &other) {
+    String moved(std::move(other));
+    swap(moved);
+  }
+  return *this;
+}
+
 String& String::operator+=(char sym) {
   push_back(sym);
   return *this;
 }
 
-String& String::operator+=(const String& other) {
-  if (capacity_ >= size_ + other.size_ - 1) {
-    memcpy(string_ + (size_ - 1), other.string_, other.size_);
-    size_ += other.size_ - 1;
-    return *this;
+String& String::operator+=(StringView other) {
+  size_t added = other.length();
+  if (allocated() < size_ + added) {
+    // other may view our own buffer, which is about to move
+    std::less<const char*> before;
+    bool inside = !before(other.data(), data()) && before(other.data(), data() + size_);
+    size_t offset = other.data() - data();
+    reallocate((size_ + added) * 2);
+    if (inside) {
+      other = StringView(data() + offset, added);
+    }
   }
-  char* buffer = new char[(size_ + other.size_ - 1) * 2];
-  memcpy(buffer, string_, size_ - 1);
-  memcpy(buffer + (size_ - 1), other.string_, other.size_);
-  delete[] string_;
-  string_ = buffer;
-  size_ += other.size_ - 1;
-  capacity_ = 2 * size_;
+  char* buffer = data();
+  memcpy(buffer + (size_ - 1), other.data(), added);
+  size_ += added;
+  buffer[size_ - 1] = '\0';
   return *this;
 }
 
-char& String::operator[](size_t index) { return string_[index]; }
+char& String::operator[](size_t index) { return data()[index]; }
 
-const char& String::operator[](size_t index) const { return string_[index]; }
+const char& String::operator[](size_t index) const { return data()[index]; }
 
 size_t String::length() const { return size_ - 1; }
 
 size_t String::size() const { return size_ - 1; }
 
-size_t String::capacity() const { return capacity_ - 1; }
+size_t String::capacity() const { return allocated() - 1; }
+
+void String::reserve(size_t count) {
+  if (count + 1 > allocated()) {
+    reallocate(count + 1);
+  }
+}
 
 void String::push_back(char sym) {
-  if (size_ == capacity_) {
-    char* buffer = new char[size_ * 2];
-    memcpy(buffer, string_, size_);
-    delete[] string_;
-    string_ = buffer;
-    capacity_ *= 2;
-  }
-  string_[size_ - 1] = sym;
-  string_[size_] = '\0';
+  if (size_ == allocated()) {
+    reallocate(size_ * 2);
+  }
+  char* buffer = data();
+  buffer[size_ - 1] = sym;
+  buffer[size_] = '\0';
   ++size_;
 }
 
 void String::pop_back() {
-  string_[size_ - 2] = '\0';
+  data()[size_ - 2] = '\0';
   --size_;
 }
 
-char& String::front() { return string_[0]; }
+char& String::front() { return data()[0]; }
 
-char& String::back() { return string_[size_ - 2]; }
+char& String::back() { return data()[size_ - 2]; }
 
-const char& String::front() const { return string_[0]; }
+const char& String::front() const { return data()[0]; }
 
-const char& String::back() const { return string_[size_ - 2]; }
+const char& String::back() const { return data()[size_ - 2]; }
 
-size_t String::find(const String& substring) const {
-  for (size_t index = 0; index < length(); ++index) {
-    if (index + substring.length() - 1 >= length()) {
-      return length();
-    }
-    size_t buf_ind = 0;
-    while (buf_ind < substring.length() && string_[index + buf_ind] == substring[buf_ind]) {
-      ++buf_ind;
-    }
-    if (buf_ind == substring.length()) {
-      return index;
-    }
-  }
-  return length();
-}
+size_t String::find(char sym, size_t pos) const { return StringView(*this).find(sym, pos); }
 
-size_t String::rfind(const String& substring) const {
-  for (int64_t index = size_ - 1 - substring.length(); index >= 0; --index) {
-    size_t buf_ind = 0;
-    while (buf_ind < substring.length() && string_[index + buf_ind] == substring[buf_ind]) {
-      ++buf_ind;
-    }
-    if (buf_ind == substring.length()) {
-      return index;
-    }
-  }
-  return length();
+size_t String::find(StringView substring, size_t pos) const {
+  return StringView(*this).find(substring, pos);
 }
 
+size_t String::rfind(StringView substring) const { return StringView(*this).rfind(substring); }
+
 String String::substr(size_t start, size_t count) const {
   String result(count);
-  memcpy(result.string_, string_ + start, count);
-  result.string_[count] = '\0';
+  memcpy(result.data(), data() + start, count);
+  result.data()[count] = '\0';
   return result;
 }
 
+StringView String::view(size_t start, size_t count) const {
+  return StringView(data() + start, count);
+}
+
 bool String::empty() const { return size_ == 1; }
 
 void String::clear() {
   size_ = 1;
-  string_[0] = '\0';
+  data()[0] = '\0';
 }
 
-void String::shrink_to_fit() {
-  char* buffer = new char[size_];
-  memcpy(buffer, string_, size_);
-  delete[] string_;
-  string_ = buffer;
-  capacity_ = size_;
-}
+void String::shrink_to_fit() { reallocate(size_); }
 
-char* String::data() { return string_; }
+char* String::data() { return is_local() ? local_ : heap_.data; }
 
-const char* String::data() const { return string_; }
+const char* String::data() const { return is_local() ? local_ : heap_.data; }
 
-String::~String() { delete[] string_; }
+String::~String() {
+  if (!is_local()) {
+    delete[] heap_.data;
+  }
+}
 
 String operator+(const String& first, const String& second) {
-  String result = first;
+  String result;
+  result.reserve(first.length() + second.length());
+  result += first;
   result += second;
   return result;
 }
 
-String operator+(String& first, char sym) {
-  String result = first;
+// A temporary on the left is appended to in place, so chains like
+// a + b + c + d reuse one buffer
+String operator+(String&& first, const String& second) {
+  first += second;
+  return std::move(first);
+}
+
+String operator+(String&& first, String&& second) {
+  first += second;
+  return std::move(first);
+}
+
+String operator+(const String& first, char sym) {
+  String result;
+  result.reserve(first.length() + 1);
+  result += first;
   result += sym;
   return result;
 }
 
+String operator+(String&& first, char sym) {
+  first += sym;
+  return std::move(first);
+}
+
 std::ostream& operator<<(std::ostream& output, const String& string) {
   output << string.data();
   return output;
 }
 
+// Whitespace as std::isspace sees it in the "C" locale
+bool String::is_space(char sym) {
+  return sym == ' ' || (sym >= '\t' && sym <= '\r');
+}
+
+// First whitespace char in [first, last), or last. All whitespace is below
+// 0x21, so eight bytes at a time are checked for any byte under 0x21 and
+// only such words are looked at byte by byte.
+const char* String::find_space(const char* first, const char* last) {
+  const uint64_t kOnes = 0x0101010101010101ULL;
+  const uint64_t kHigh = 0x8080808080808080ULL;
+  while (last - first >= 8) {
+    uint64_t word;
+    memcpy(&word, first, 8);
+    if (((word - kOnes * 0x21) & ~word & kHigh) != 0) {
+      // May be another control char, then the word scan goes on
+      for (size_t i = 0; i < 8; ++i) {
+        if (is_space(first[i])) {
+          return first + i;
+        }
+      }
+    }
+    first += 8;
+  }
+  while (first != last && !is_space(*first)) {
+    ++first;
+  }
+  return first;
+}
+
+// Gives access to the get area of any streambuf: naming the protected
+// members through a derived class yields member pointers usable on the
+// base object
+struct String::StreamBufferAccess : std::streambuf {
+  static const char* begin(std::streambuf* buffer) {
+    return (buffer->*&StreamBufferAccess::gptr)();
+  }
+  static const char* end(std::streambuf* buffer) {
+    return (buffer->*&StreamBufferAccess::egptr)();
+  }
+  static void advance(std::streambuf* buffer, size_t count) {
+    (buffer->*&StreamBufferAccess::gbump)(static_cast<int>(count));
+  }
+};
+
+// Whole runs of the token are copied out of the stream buffer at once;
+// streams without a get area are read char by char
 std::istream& operator>>(std::istream& input, String& string) {
-  string = "";
-  char buffer = ' ';
-  while (buffer == ' ') {
-    input.get(buffer);
-  }
-  string += buffer;
-  while (input.get(buffer)) {
-    if (std::isspace(buffer)) {
+  std::istream::sentry sentry(input);
+  string.clear();
+  if (!sentry) {
+    return input;
+  }
+  std::streambuf* source = input.rdbuf();
+  int sym = source->sgetc();
+  while (sym != std::char_traits<char>::eof()) {
+    const char* first = String::StreamBufferAccess::begin(source);
+    const char* last = String::StreamBufferAccess::end(source);
+    if (first == last) {
+      if (String::is_space(static_cast<char>(sym))) {
+        break;
+      }
+      string.push_back(static_cast<char>(sym));
+      sym = source->snextc();
+      continue;
+    }
+    const char* space = String::find_space(first, last);
+    string += StringView(first, space - first);
+    String::StreamBufferAccess::advance(source, space - first);
+    if (space != last) {
       break;
     }
-    string.push_back(buffer);
+    sym = source->sgetc();
+  }
+  if (sym == std::char_traits<char>::eof()) {
+    input.setstate(std::ios::eofbit);
+  }
+  if (string.empty()) {
+    input.setstate(std::ios::failbit);
   }
   return input;
 }
 
+// Splits text at whitespace without copying; the views point into text
+std::vector<StringView> readTokens(StringView text) {
+  std::vector<StringView> tokens;
+  const char* cur = text.data();
+  const char* last = text.data() + text.length();
+  while (cur != last) {
+    while (cur != last && String::is_space(*cur)) {
+      ++cur;
+    }
+    if (cur == last) {
+      break;
+    }
+    const char* space = String::find_space(cur, last);
+    tokens.emplace_back(cur, space - cur);
+    cur = space;
+  }
+  return tokens;
+}
+
 bool operator==(const String& first, const String& second) {
   return strcmp(first.data(), second.data()) == 0;
 }
@@ -258,3 +605,790 @@ bool operator<=(const String& first, const String& second) {
 bool operator>=(const String& first, const String& second) {
   return strcmp(first.data(), second.data()) >= 0;
 }
+
+std::ostream& operator<<(std::ostream& output, StringView view) {
+  output.write(view.data(), view.length());
+  return output;
+}
+
+bool operator==(StringView first, StringView second) {
+  return first.length() == second.length() && first.compare(second) == 0;
+}
+
+bool operator!=(StringView first, StringView second) { return !(first == second); }
+
+bool operator<(StringView first, StringView second) { return first.compare(second) < 0; }
+
+bool operator>(StringView first, StringView second) { return first.compare(second) > 0; }
+
+bool operator<=(StringView first, StringView second) { return first.compare(second) <= 0; }
+
+bool operator>=(StringView first, StringView second) { return first.compare(second) >= 0; }
+
+Searcher::Searcher(StringView pattern) : pattern_(pattern) {
+  fill_shift(pattern_, shift_);
+  fill_rshift(pattern_, rshift_);
+}
+
+const char* Searcher::scan(StringView pattern, const char* first, const char* last) {
+  size_t len = pattern.length();
+  const char* end = last - len + 1;
+  for (const char* cur = first; cur < end; ++cur) {
+    cur = static_cast<const char*>(memchr(cur, pattern[0], end - cur));
+    if (cur == nullptr) {
+      return last;
+    }
+    if (memcmp(cur + 1, pattern.data() + 1, len - 1) == 0) {
+      return cur;
+    }
+  }
+  return last;
+}
+
+const char* Searcher::rscan(StringView pattern, const char* first, const char* last) {
+  size_t len = pattern.length();
+  char head = pattern[0];
+  for (const char* cur = last - len;; --cur) {
+    if (*cur == head && memcmp(cur + 1, pattern.data() + 1, len - 1) == 0) {
+      return cur;
+    }
+    if (cur == first) {
+      return last;
+    }
+  }
+}
+
+void Searcher::fill_shift(StringView pattern, size_t* shift) {
+  size_t len = pattern.length();
+  std::fill(shift, shift + 256, len);
+  for (size_t i = 0; i + 1 < len; ++i) {
+    shift[static_cast<unsigned char>(pattern[i])] = len - 1 - i;
+  }
+}
+
+void Searcher::fill_rshift(StringView pattern, size_t* rshift) {
+  size_t len = pattern.length();
+  std::fill(rshift, rshift + 256, len);
+  for (size_t i = len; i > 1; --i) {
+    rshift[static_cast<unsigned char>(pattern[i - 1])] = i - 1;
+  }
+}
+
+const char* Searcher::horspool(StringView pattern, const size_t* shift, const char* first,
+                               const char* last) {
+  size_t len = pattern.length();
+  const char* end = last - len + 1;
+  char tail = pattern[len - 1];
+  for (const char* cur = first; cur < end;) {
+    char sym = cur[len - 1];
+    if (sym == tail && memcmp(cur, pattern.data(), len - 1) == 0) {
+      return cur;
+    }
+    cur += shift[static_cast<unsigned char>(sym)];
+  }
+  return last;
+}
+
+// Mirror image of horspool: the window moves left and is aligned on its
+// first byte
+const char* Searcher::rhorspool(StringView pattern, const size_t* rshift, const char* first,
+                                const char* last) {
+  size_t len = pattern.length();
+  char head = pattern[0];
+  for (const char* cur = last - len;;) {
+    char sym = *cur;
+    if (sym == head && memcmp(cur + 1, pattern.data() + 1, len - 1) == 0) {
+      return cur;
+    }
+    size_t shift = rshift[static_cast<unsigned char>(sym)];
+    if (static_cast<size_t>(cur - first) < shift) {
+      return last;
+    }
+    cur -= shift;
+  }
+}
+
+const char* Searcher::search(const char* first, const char* last) const {
+  size_t len = pattern_.length();
+  if (len == 0 || static_cast<size_t>(last - first) < len) {
+    return last;
+  }
+  if (len < kShortPattern) {
+    return scan(pattern_, first, last);
+  }
+  return horspool(pattern_, shift_, first, last);
+}
+
+const char* Searcher::rsearch(const char* first, const char* last) const {
+  size_t len = pattern_.length();
+  if (len == 0 || static_cast<size_t>(last - first) < len) {
+    return last;
+  }
+  if (len < kShortPattern) {
+    return rscan(pattern_, first, last);
+  }
+  return rhorspool(pattern_, rshift_, first, last);
+}
+
+size_t Searcher::find(StringView text, size_t pos) const {
+  if (pos >= text.length()) {
+    return text.length();
+  }
+  const char* last = text.data() + text.length();
+  return search(text.data() + pos, last) - text.data();
+}
+
+size_t Searcher::rfind(StringView text) const {
+  const char* last = text.data() + text.length();
+  return rsearch(text.data(), last) - text.data();
+}
+
+// Multi-pattern search: an Aho-Corasick automaton compiled to a dense DFA
+// over byte classes. Bytes that occur in no pattern share one class, so the
+// table has (distinct pattern bytes + 1) columns instead of 256. Transitions
+// store the premultiplied row of the target state, with the top bit set
+// when the target ends some pattern, so the hot loop is one load per byte.
+class AhoCorasick {
+ public:
+  struct Match {
+    size_t pattern;
+    size_t start;
+    size_t end;
+  };
+
+  // Feeds text in chunks of any size; matches that span chunk boundaries
+  // are reported with positions counted from the start of the stream
+  class Matcher {
+   private:
+    const AhoCorasick* automaton_;
+    uint32_t state_;
+    size_t offset_;
+
+   public:
+    explicit Matcher(const AhoCorasick& automaton);
+
+    // callback(const Match&) for every occurrence ending in the chunk
+    template <typename Callback>
+    void feed(const char* first, const char* last, Callback callback);
+    template <typename Callback>
+    void feed(const String& chunk, Callback callback);
+    void reset();
+  };
+
+  // Empty patterns are never found
+  explicit AhoCorasick(const std::vector<String>& patterns);
+
+  template <typename Callback>
+  void scan(const char* first, const char* last, Callback callback) const;
+  std::vector<Match> find_all(const String& text) const;
+
+  size_t pattern_count() const;
+  size_t pattern_length(size_t pattern) const;
+  size_t state_count() const;
+
+ private:
+  static constexpr uint32_t kOutput = 1u << 31;
+  static constexpr uint32_t kNone = ~0u;
+
+  template <typename Callback>
+  void report(uint32_t row, size_t end, Callback& callback) const;
+
+  uint8_t class_[256];
+  uint32_t classes_;
+  std::vector<uint32_t> next_;
+  // Per state: patterns ending exactly there (CSR in outputs_) and the
+  // nearest state on the failure chain that ends some pattern
+  std::vector<uint32_t> output_begin_;
+  std::vector<uint32_t> outputs_;
+  std::vector<uint32_t> dict_link_;
+  std::vector<size_t> lengths_;
+};
+
+AhoCorasick::AhoCorasick(const std::vector<String>& patterns) : classes_(0) {
+  bool seen[256] = {};
+  for (const String& pattern : patterns) {
+    for (size_t i = 0; i < pattern.length(); ++i) {
+      unsigned char sym = pattern[i];
+      if (!seen[sym]) {
+        seen[sym] = true;
+        class_[sym] = classes_++;
+      }
+    }
+  }
+  if (classes_ < 256) {
+    for (size_t sym = 0; sym < 256; ++sym) {
+      if (!seen[sym]) {
+        class_[sym] = classes_;
+      }
+    }
+    ++classes_;
+  }
+
+  // Trie, with kNone for missing edges and state ids (not rows) as targets
+  std::vector<uint32_t> trie(classes_, kNone);
+  std::vector<std::vector<uint32_t>> ends(1);
+  for (size_t index = 0; index < patterns.size(); ++index) {
+    const String& pattern = patterns[index];
+    lengths_.push_back(pattern.length());
+    if (pattern.empty()) {
+      continue;
+    }
+    uint32_t state = 0;
+    for (size_t i = 0; i < pattern.length(); ++i) {
+      uint32_t cls = class_[static_cast<unsigned char>(pattern[i])];
+      if (trie[state * classes_ + cls] == kNone) {
+        if ((ends.size() + 1) * classes_ >= kOutput) {
+          throw std::length_error("AhoCorasick automaton is too large");
+        }
+        trie[state * classes_ + cls] = ends.size();
+        trie.resize(trie.size() + classes_, kNone);
+        ends.emplace_back();
+      }
+      state = trie[state * classes_ + cls];
+    }
+    ends[state].push_back(index);
+  }
+
+  // Breadth-first: failure links, missing edges filled from the failure
+  // state, dictionary links
+  size_t states = ends.size();
+  std::vector<uint32_t> fail(states, 0);
+  dict_link_.assign(states, kNone);
+  std::vector<uint32_t> order{0};
+  for (size_t head = 0; head < order.size(); ++head) {
+    uint32_t state = order[head];
+    for (uint32_t cls = 0; cls < classes_; ++cls) {
+      uint32_t& target = trie[state * classes_ + cls];
+      uint32_t fallback = (state == 0 ? 0 : trie[fail[state] * classes_ + cls]);
+      if (target == kNone) {
+        target = fallback;
+        continue;
+      }
+      fail[target] = fallback;
+      dict_link_[target] = (ends[fallback].empty() ? dict_link_[fallback] : fallback);
+      order.push_back(target);
+    }
+  }
+
+  next_.resize(trie.size());
+  for (size_t i = 0; i < trie.size(); ++i) {
+    uint32_t target = trie[i];
+    bool output = !ends[target].empty() || dict_link_[target] != kNone;
+    next_[i] = target * classes_ | (output ? kOutput : 0);
+  }
+  output_begin_.push_back(0);
+  for (const std::vector<uint32_t>& list : ends) {
+    outputs_.insert(outputs_.end(), list.begin(), list.end());
+    output_begin_.push_back(outputs_.size());
+  }
+}
+
+template <typename Callback>
+void AhoCorasick::report(uint32_t row, size_t end, Callback& callback) const {
+  for (uint32_t state = row / classes_; state != kNone; state = dict_link_[state]) {
+    for (uint32_t i = output_begin_[state]; i < output_begin_[state + 1]; ++i) {
+      callback(Match{outputs_[i], end - lengths_[outputs_[i]], end});
+    }
+  }
+}
+
+template <typename Callback>
+void AhoCorasick::scan(const char* first, const char* last, Callback callback) const {
+  Matcher matcher(*this);
+  matcher.feed(first, last, callback);
+}
+
+std::vector<AhoCorasick::Match> AhoCorasick::find_all(const String& text) const {
+  std::vector<Match> matches;
+  scan(text.data(), text.data() + text.length(),
+       [&matches](const Match& match) { matches.push_back(match); });
+  return matches;
+}
+
+size_t AhoCorasick::pattern_count() const { return lengths_.size(); }
+
+size_t AhoCorasick::pattern_length(size_t pattern) const { return lengths_[pattern]; }
+
+size_t AhoCorasick::state_count() const { return output_begin_.size() - 1; }
+
+AhoCorasick::Matcher::Matcher(const AhoCorasick& automaton)
+    : automaton_(&automaton), state_(0), offset_(0) {}
+
+template <typename Callback>
+void AhoCorasick::Matcher::feed(const char* first, const char* last, Callback callback) {
+  const uint8_t* classes = automaton_->class_;
+  const uint32_t* next = automaton_->next_.data();
+  uint32_t state = state_;
+  for (const char* cur = first; cur != last; ++cur) {
+    uint32_t target = next[state + classes[static_cast<unsigned char>(*cur)]];
+    state = target & ~kOutput;
+    if (target & kOutput) {
+      automaton_->report(state, offset_ + (cur - first) + 1, callback);
+    }
+  }
+  state_ = state;
+  offset_ += last - first;
+}
+
+template <typename Callback>
+void AhoCorasick::Matcher::feed(const String& chunk, Callback callback) {
+  feed(chunk.data(), chunk.data() + chunk.length(), callback);
+}
+
+void AhoCorasick::Matcher::reset() {
+  state_ = 0;
+  offset_ = 0;
+}
+
+// Persistent rope: an AVL tree whose leaves are ranges of shared, immutable
+// Strings. Copies share the whole tree; every change builds O(log n) new
+// nodes on top of it. Everything is expressed through join (concatenate
+// two balanced trees) and split, so concat, split, insert and erase are
+// O(log n), and splitting a leaf only narrows its range, no chars move.
+class Rope {
+ private:
+  struct Node;
+  using NodePtr = std::shared_ptr<const Node>;
+
+  struct Node {
+    NodePtr left;
+    NodePtr right;
+    // Leaves only
+    std::shared_ptr<const String> text;
+    size_t offset;
+    size_t length;
+    int height;
+  };
+
+  // Text is cut into leaves of kLeafSize; neighbouring leaves shorter than
+  // kMergeSize together are merged when joined, so appending many small
+  // pieces does not degrade into one node per piece
+  static constexpr size_t kLeafSize = 1024;
+  static constexpr size_t kMergeSize = 256;
+
+  NodePtr root_;
+
+  explicit Rope(NodePtr root);
+
+  static int height(const NodePtr& node);
+  static size_t length(const NodePtr& node);
+  static NodePtr make_leaf(std::shared_ptr<const String> text, size_t offset, size_t length);
+  static NodePtr make_node(NodePtr left, NodePtr right);
+  static NodePtr balance(NodePtr left, NodePtr right);
+  static NodePtr join(NodePtr left, NodePtr right);
+  static std::pair<NodePtr, NodePtr> split(const NodePtr& node, size_t pos);
+  static NodePtr build(StringView text);
+  template <typename Callback>
+  static void visit(const NodePtr& node, Callback& callback);
+
+ public:
+  // Constructors
+  Rope();
+  explicit Rope(StringView text);
+
+  // Operators
+  Rope& operator+=(const Rope& other);
+  Rope& operator+=(StringView text);
+  char operator[](size_t index) const;
+
+  // Methods
+  size_t length() const;
+  size_t size() const;
+  bool empty() const;
+  // First pos chars and the rest
+  std::pair<Rope, Rope> split(size_t pos) const;
+  Rope substr(size_t start, size_t count) const;
+  void insert(size_t pos, const Rope& other);
+  void insert(size_t pos, StringView text);
+  void erase(size_t pos, size_t count);
+  String flatten() const;
+  // callback(StringView) for every leaf, in order
+  template <typename Callback>
+  void for_each_chunk(Callback callback) const;
+};
+
+Rope::Rope() = default;
+
+Rope::Rope(NodePtr root) : root_(std::move(root)) {}
+
+Rope::Rope(StringView text) : root_(build(text)) {}
+
+int Rope::height(const NodePtr& node) { return node == nullptr ? 0 : node->height; }
+
+size_t Rope::length(const NodePtr& node) { return node == nullptr ? 0 : node->length; }
+
+Rope::NodePtr Rope::make_leaf(std::shared_ptr<const String> text, size_t offset, size_t length) {
+  return std::make_shared<const Node>(Node{nullptr, nullptr, std::move(text), offset, length, 1});
+}
+
+Rope::NodePtr Rope::make_node(NodePtr left, NodePtr right) {
+  int node_height = std::max(left->height, right->height) + 1;
+  size_t node_length = left->length + right->length;
+  return std::make_shared<const Node>(
+      Node{std::move(left), std::move(right), nullptr, 0, node_length, node_height});
+}
+
+// Joins two AVL trees whose heights differ by at most two
+Rope::NodePtr Rope::balance(NodePtr left, NodePtr right) {
+  if (height(left) > height(right) + 1) {
+    if (height(left->left) >= height(left->right)) {
+      return make_node(left->left, make_node(left->right, std::move(right)));
+    }
+    return make_node(make_node(left->left, left->right->left),
+                     make_node(left->right->right, std::move(right)));
+  }
+  if (height(right) > height(left) + 1) {
+    if (height(right->right) >= height(right->left)) {
+      return make_node(make_node(std::move(left), right->left), right->right);
+    }
+    return make_node(make_node(std::move(left), right->left->left),
+                     make_node(right->left->right, right->right));
+  }
+  return make_node(std::move(left), std::move(right));
+}
+
+// Walks down the spine of the taller tree to a subtree of matching height,
+// so the cost is the height difference
+Rope::NodePtr Rope::join(NodePtr left, NodePtr right) {
+  if (left == nullptr) {
+    return right;
+  }
+  if (right == nullptr) {
+    return left;
+  }
+  if (left->text != nullptr && right->text != nullptr &&
+      left->length + right->length <= kMergeSize) {
+    auto merged = std::make_shared<String>(
+        StringView(left->text->data() + left->offset, left->length));
+    *merged += StringView(right->text->data() + right->offset, right->length);
+    return make_leaf(std::move(merged), 0, left->length + right->length);
+  }
+  if (left->height > right->height + 1) {
+    return balance(left->left, join(left->right, std::move(right)));
+  }
+  if (right->height > left->height + 1) {
+    return balance(join(std::move(left), right->left), right->right);
+  }
+  return make_node(std::move(left), std::move(right));
+}
+
+std::pair<Rope::NodePtr, Rope::NodePtr> Rope::split(const NodePtr& node, size_t pos) {
+  if (node == nullptr || pos == 0) {
+    return {nullptr, node};
+  }
+  if (pos >= node->length) {
+    return {node, nullptr};
+  }
+  if (node->text != nullptr) {
+    return {make_leaf(node->text, node->offset, pos),
+            make_leaf(node->text, node->offset + pos, node->length - pos)};
+  }
+  if (pos < node->left->length) {
+    auto [first, second] = split(node->left, pos);
+    return {std::move(first), join(std::move(second), node->right)};
+  }
+  auto [first, second] = split(node->right, pos - node->left->length);
+  return {join(node->left, std::move(first)), std::move(second)};
+}
+
+// Cuts text into leaves and builds a perfectly balanced tree over them
+Rope::NodePtr Rope::build(StringView text) {
+  if (text.empty()) {
+    return nullptr;
+  }
+  if (text.length() <= kLeafSize) {
+    return make_leaf(std::make_shared<const String>(text), 0, text.length());
+  }
+  size_t leaves = (text.length() + kLeafSize - 1) / kLeafSize;
+  size_t middle = leaves / 2 * kLeafSize;
+  return make_node(build(text.substr(0, middle)),
+                   build(text.substr(middle, text.length() - middle)));
+}
+
+template <typename Callback>
+void Rope::visit(const NodePtr& node, Callback& callback) {
+  if (node == nullptr) {
+    return;
+  }
+  if (node->text != nullptr) {
+    callback(StringView(node->text->data() + node->offset, node->length));
+    return;
+  }
+  visit(node->left, callback);
+  visit(node->right, callback);
+}
+
+Rope& Rope::operator+=(const Rope& other) {
+  root_ = join(std::move(root_), other.root_);
+  return *this;
+}
+
+Rope& Rope::operator+=(StringView text) {
+  root_ = join(std::move(root_), build(text));
+  return *this;
+}
+
+char Rope::operator[](size_t index) const {
+  const Node* node = root_.get();
+  while (node->text == nullptr) {
+    if (index < node->left->length) {
+      node = node->left.get();
+    } else {
+      index -= node->left->length;
+      node = node->right.get();
+    }
+  }
+  return (*node->text)[node->offset + index];
+}
+
+size_t Rope::length() const { return length(root_); }
+
+size_t Rope::size() const { return length(root_); }
+
+bool Rope::empty() const { return root_ == nullptr; }
+
+std::pair<Rope, Rope> Rope::split(size_t pos) const {
+  auto [first, second] = split(root_, pos);
+  return {Rope(std::move(first)), Rope(std::move(second))};
+}
+
+Rope Rope::substr(size_t start, size_t count) const {
+  return Rope(split(split(root_, start).second, count).first);
+}
+
+void Rope::insert(size_t pos, const Rope& other) {
+  auto [first, second] = split(root_, pos);
+  root_ = join(join(std::move(first), other.root_), std::move(second));
+}
+
+void Rope::insert(size_t pos, StringView text) { insert(pos, Rope(text)); }
+
+void Rope::erase(size_t pos, size_t count) {
+  auto [first, rest] = split(root_, pos);
+  root_ = join(std::move(first), split(rest, count).second);
+}
+
+template <typename Callback>
+void Rope::for_each_chunk(Callback callback) const {
+  visit(root_, callback);
+}
+
+String Rope::flatten() const {
+  String result;
+  result.reserve(length());
+  for_each_chunk([&result](StringView chunk) { result += chunk; });
+  return result;
+}
+
+Rope operator+(const Rope& first, const Rope& second) {
+  Rope result = first;
+  result += second;
+  return result;
+}
+
+std::ostream& operator<<(std::ostream& output, const Rope& rope) {
+  rope.for_each_chunk([&output](StringView chunk) { output << chunk; });
+  return output;
+}
+
+// Thread-safe interning table. Each distinct text is stored once in an
+// arena, NUL-terminated and preceded by its uint32_t length, and never
+// moves or dies, so an interned pointer identifies the text for good.
+// The table is split into kShards shards by hash, each with its own mutex,
+// open-addressing slots and arena, so threads rarely wait on each other.
+class SymbolTable {
+ private:
+  static constexpr size_t kShards = 16;
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  struct Slot {
+    uint64_t hash;
+    const char* text;
+  };
+
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::vector<Slot> slots;
+    size_t count = 0;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* free = nullptr;
+    size_t left = 0;
+    size_t bytes = 0;
+  };
+
+  Shard shards_[kShards];
+
+  static uint64_t hash(StringView text);
+  static const char* store(Shard& shard, StringView text);
+  static void grow(Shard& shard);
+
+ public:
+  // Never destroyed, so Symbols stay valid during static destruction
+  static SymbolTable& global();
+
+  // Interned copy of text: equal texts give the same pointer
+  const char* intern(StringView text);
+  // Text behind a pointer returned by intern
+  static StringView view(const char* interned);
+  // Distinct texts interned and bytes held by the arenas and slots
+  size_t size();
+  size_t memory_usage();
+};
+
+// Handle of an interned text, the size of a pointer. Equality is a pointer
+// compare; the text stays reachable through view() and str().
+class Symbol {
+ private:
+  const char* text_;
+
+ public:
+  // Constructors
+  Symbol();
+  explicit Symbol(StringView text);
+
+  // Methods
+  StringView view() const;
+  String str() const;
+  size_t length() const;
+  const char* data() const;
+};
+
+uint64_t SymbolTable::hash(StringView text) {
+  const uint64_t kMul = 0x9E3779B97F4A7C15ULL;
+  uint64_t result = text.length() * kMul;
+  size_t pos = 0;
+  for (; pos + 8 <= text.length(); pos += 8) {
+    uint64_t word;
+    memcpy(&word, text.data() + pos, 8);
+    result = (result ^ word) * kMul;
+    result ^= result >> 32;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, text.data() + pos, text.length() - pos);
+  result = (result ^ tail) * kMul;
+  return result ^ (result >> 29);
+}
+
+// Bump-allocates [length][text]['\0'] in the shard's arena; texts bigger
+// than a block get a block of their own
+const char* SymbolTable::store(Shard& shard, StringView text) {
+  if (text.length() > UINT32_MAX) {
+    throw std::length_error("Symbol text is too long");
+  }
+  size_t needed = (sizeof(uint32_t) + text.length() + 1 + alignof(uint32_t) - 1) &
+                  ~(alignof(uint32_t) - 1);
+  char* place;
+  if (needed > kBlockSize / 4) {
+    shard.blocks.emplace_back(new char[needed]);
+    place = shard.blocks.back().get();
+    shard.bytes += needed;
+  } else {
+    if (needed > shard.left) {
+      shard.blocks.emplace_back(new char[kBlockSize]);
+      shard.free = shard.blocks.back().get();
+      shard.left = kBlockSize;
+      shard.bytes += kBlockSize;
+    }
+    place = shard.free;
+    shard.free += needed;
+    shard.left -= needed;
+  }
+  uint32_t length = text.length();
+  memcpy(place, &length, sizeof(length));
+  memcpy(place + sizeof(length), text.data(), text.length());
+  place[sizeof(length) + text.length()] = '\0';
+  return place + sizeof(length);
+}
+
+void SymbolTable::grow(Shard& shard) {
+  std::vector<Slot> slots(shard.slots.empty() ? 64 : shard.slots.size() * 2, Slot{0, nullptr});
+  size_t mask = slots.size() - 1;
+  for (const Slot& slot : shard.slots) {
+    if (slot.text == nullptr) {
+      continue;
+    }
+    size_t index = slot.hash & mask;
+    while (slots[index].text != nullptr) {
+      index = (index + 1) & mask;
+    }
+    slots[index] = slot;
+  }
+  shard.slots.swap(slots);
+}
+
+SymbolTable& SymbolTable::global() {
+  static SymbolTable* table = new SymbolTable;
+  return *table;
+}
+
+// The top bits pick the shard, the low bits the slot inside it
+const char* SymbolTable::intern(StringView text) {
+  uint64_t text_hash = hash(text);
+  Shard& shard = shards_[text_hash >> 60 & (kShards - 1)];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (2 * (shard.count + 1) > shard.slots.size()) {
+    grow(shard);
+  }
+  size_t mask = shard.slots.size() - 1;
+  size_t index = text_hash & mask;
+  for (; shard.slots[index].text != nullptr; index = (index + 1) & mask) {
+    const Slot& slot = shard.slots[index];
+    if (slot.hash == text_hash && view(slot.text) == text) {
+      return slot.text;
+    }
+  }
+  shard.slots[index] = Slot{text_hash, store(shard, text)};
+  ++shard.count;
+  return shard.slots[index].text;
+}
+
+StringView SymbolTable::view(const char* interned) {
+  uint32_t length;
+  memcpy(&length, interned - sizeof(length), sizeof(length));
+  return StringView(interned, length);
+}
+
+size_t SymbolTable::size() {
+  size_t result = 0;
+  for (Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    result += shard.count;
+  }
+  return result;
+}
+
+size_t SymbolTable::memory_usage() {
+  size_t result = 0;
+  for (Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    result += shard.bytes + shard.slots.capacity() * sizeof(Slot);
+  }
+  return result;
+}
+
+Symbol::Symbol() : Symbol(StringView()) {}
+
+Symbol::Symbol(StringView text) : text_(SymbolTable::global().intern(text)) {}
+
+StringView Symbol::view() const { return SymbolTable::view(text_); }
+
+String Symbol::str() const { return String(view()); }
+
+size_t Symbol::length() const { return view().length(); }
+
+const char* Symbol::data() const { return text_; }
+
+bool operator==(Symbol first, Symbol second) { return first.data() == second.data(); }
+
+bool operator!=(Symbol first, Symbol second) { return first.data() != second.data(); }
+
+std::ostream& operator<<(std::ostream& output, Symbol symbol) {
+  return output << symbol.view();
+}
+
+template <>
+struct std::hash<Symbol> {
+  size_t operator()(Symbol symbol) const {
+    return std::hash<const char*>()(symbol.data());
+  }
+};